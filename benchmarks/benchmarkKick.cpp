@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+#include <blond/math_functions.h>
+#include <blond/utilities.h>
+#include <cmath>
+
+// Throughput and accuracy of the sine kernels in the loop of the RF kick,
+// RingAndRfSection::kick, for two RF systems. The max_error counter is the
+// largest absolute error of a kernel against std::sin on the phases of the
+// benchmark
+
+const int n_rf = 2;
+const ftype voltage[n_rf] = {6e6, -1.5e6};
+const ftype omega_rf[n_rf] = {2.5e9, 5e9};
+const ftype phi_rf[n_rf] = {0.3, 0.6};
+
+static f_vector_t phases(const uint n) {
+    // Macroparticles spread over a few RF periods
+    f_vector_t dt(n);
+    for (uint i = 0; i < n; ++i)
+        dt[i] = 1e-8 * i / n + 1e-10 * std::sin(0.1 * i);
+    return dt;
+}
+
+template <int Degree>
+static void BM_kick(benchmark::State& state) {
+    const uint n = state.range(0);
+    const f_vector_t dt = phases(n);
+    f_vector_t dE(n, 0);
+
+    for (auto _ : state) {
+        for (int j = 0; j < n_rf; ++j) {
+#pragma omp parallel for
+            for (uint i = 0; i < n; ++i)
+                dE[i] += voltage[j] * mymath::fast_sin<Degree>(
+                                          omega_rf[j] * dt[i] + phi_rf[j]);
+        }
+        benchmark::DoNotOptimize(dE.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * n_rf);
+
+    ftype error = 0;
+    for (int j = 0; j < n_rf; ++j)
+        for (uint i = 0; i < n; ++i) {
+            const ftype a = omega_rf[j] * dt[i] + phi_rf[j];
+            error = std::max(
+                error, std::abs(mymath::fast_sin<Degree>(a) - std::sin(a)));
+        }
+    state.counters["max_error"] = error;
+}
+
+static void BM_kick_std(benchmark::State& state) {
+    const uint n = state.range(0);
+    const f_vector_t dt = phases(n);
+    f_vector_t dE(n, 0);
+
+    for (auto _ : state) {
+        for (int j = 0; j < n_rf; ++j) {
+#pragma omp parallel for
+            for (uint i = 0; i < n; ++i)
+                dE[i] +=
+                    voltage[j] * std::sin(omega_rf[j] * dt[i] + phi_rf[j]);
+        }
+        benchmark::DoNotOptimize(dE.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * n_rf);
+    state.counters["max_error"] = 0;
+}
+
+BENCHMARK(BM_kick_std)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_kick, 7)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_kick, 9)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_kick, 11)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_kick, 13)->Arg(1 << 20);
+
+BENCHMARK_MAIN();
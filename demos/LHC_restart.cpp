@@ -130,6 +130,7 @@ int main(int argc, char **argv)
       Beam->id[k] = v2[i + 2];
       k++;
    }
+   Beam->dt_version++;
 
 	Context::Slice = new Slices(N_slices, 0, -0.5e-9, 3e-9);
 	auto Slice = Context::Slice;
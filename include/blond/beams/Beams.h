@@ -29,6 +29,10 @@ class API Beams {
     uint n_macroparticles_lost;
     uint n_macroparticles;
     long intensity;
+    // *Increased whenever dt is modified or the particles are reordered, by
+    // the trackers and the slicing. Code that changes dt elsewhere increases
+    // it as well, so that stored slicing bins are not reused*
+    uint dt_version = 0;
     Beams(const uint _n_macroparticles, const long _intensity);
     ~Beams();
     uint n_macroparticles_alive();
@@ -80,6 +80,7 @@ inline void longitudinal_bigaussian(ftype sigma_dt, ftype sigma_dE = 0,
         // for (uint i = 0; i < Beam->n_macroparticles; ++i)
         // Beam->dE[i] = sigma_dE * distribution(generator);
     }
+    Beam->dt_version++;
 
     // TODO if reinsertion == true
     if (reinsertion) {
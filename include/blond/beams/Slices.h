@@ -11,6 +11,7 @@
 class Slices;
 
 #include <blond/configuration.h>
+#include <blond/fft.h>
 #include <blond/utilities.h>
 
 const ftype cfwhm = 2 * sqrt(2 * log(2));
@@ -19,6 +20,12 @@ enum cuts_unit_type { s, rad };
 
 enum fit_type { normal_fit, gaussian_fit };
 
+enum derivative_type {
+    gradient_derivative,
+    filter1d_derivative,
+    diff_derivative
+};
+
 class API Slices {
   public:
     ftype bl_fwhm, bp_fwhm;
@@ -32,10 +39,25 @@ class API Slices {
     f_vector_t edges;
     f_vector_t bin_centers;
     fit_type fit_option;
-    complex_vector_t fBeamSpectrum;
+    fft::aligned_complex_vector_t fBeamSpectrum;
     f_vector_t fBeamSpectrumFreq;
     ftype bl_gauss = 0;
     ftype bp_gauss = 0;
+    // *When set, every slicing also keeps the bin index (-1 if outside the
+    // frame) and the fractional position inside the bin of each particle,
+    // so that the induced voltage kick does not have to recompute them*
+    bool store_bins = false;
+    int_vector_t bin_index;
+    f_vector_t bin_fraction;
+    // *When set, the frame follows the bunch: the cuts are moved by whole
+    // bins once the smoothed profile centroid is at least frame_tolerance
+    // bins away from the centre of the frame. frame_smoothing is the weight
+    // of the newest centroid in the running estimate and frame_version is
+    // increased on every move, so that users of the slicing can reprocess*
+    bool track_frame = false;
+    ftype frame_smoothing = 0.5;
+    uint frame_tolerance = 1;
+    uint frame_version = 0;
 
     Slices(uint _n_slices, int _n_sigma = 0, ftype cut_left = 0,
            ftype cut_right = 0, cuts_unit_type cuts_unit = s,
@@ -46,23 +68,39 @@ class API Slices {
     ftype fast_fwhm();
     void fwhm(const ftype shift = 0);
     void beam_spectrum_generation(uint n, bool onlyRFFT = false);
-    void beam_profile_derivative();
+    f_vector_t
+    beam_profile_derivative(derivative_type mode = gradient_derivative);
     void beam_profile_filter_chebyshev();
+    bool bins_valid();
+    bool track_cuts();
 
   private:
+    // Beam dt_version, frame_version and cuts at the time bin_index was
+    // filled
+    uint bins_version = 0;
+    uint bins_frame = 0;
+    ftype bins_cut_left = 0;
+    ftype bins_cut_right = 0;
+    // Smoothed distance of the bunch centroid from the frame centre in bins
+    ftype frame_offset = 0;
+    // Zero padded profile transformed by beam_spectrum_generation, in FFTW
+    // aligned memory as fBeamSpectrum so that no copy is needed
+    fft::aligned_f_vector_t spectrum_profile;
+
     void set_cuts();
     void sort_particles();
     inline ftype convert_coordinates(ftype cut, cuts_unit_type type);
 
     inline void histogram(const ftype* __restrict input, int* __restrict output,
                           const ftype cut_left, const ftype cut_right,
-                          const uint n_slices, const uint n_macroparticles);
+                          const uint n_slices, const uint n_macroparticles,
+                          int* __restrict bins = NULL,
+                          ftype* __restrict fractions = NULL);
     inline void smooth_histogram(const ftype* __restrict input,
                                  int* __restrict output, const ftype cut_left,
                                  const ftype cut_right, const uint n_slices,
                                  const uint n_macroparticles);
     inline void slice_constant_space_histogram();
-    void track_cuts();
     void slice_constant_space_histogram_smooth();
     void rms();
     ftype gauss(const ftype x, const ftype x0, const ftype sx, const ftype A);
@@ -15,6 +15,9 @@
 #include <cmath>
 #include <fftw3.h>
 #include <functional>
+#include <mutex>
+#include <new>
+#include <string>
 
 namespace fft {
 
@@ -31,8 +34,11 @@ namespace fft {
     // FFTW_DESTROY_INPUT : use the original input to store arbitaty data.
     // May yield better performance but the input is not usable any more.
     // Can be combined with all the above
+
+    // Default of planner_flags()
     const uint FFTW_FLAGS = FFTW_ESTIMATE | FFTW_DESTROY_INPUT;
     // const uint FFTW_FLAGS = FFTW_ESTIMATE;// | FFTW_DESTROY_INPUT;
+    // Default crossovers of the thread policy, see fft_threads
     const uint ELEMS_PER_THREAD_FFT = 10000;
     const uint ELEMS_PER_THREAD_RFFT = 15000;
 
@@ -44,9 +50,70 @@ namespace fft {
         fft_type_t type;
         void* in;
         void* out;
+        std::mutex lock; // held while in and out are in use
     };
 
-    static std::vector<fft::fft_plan_t> planV;
+    // *The plans of rfft, fft, ifft and irfft below are kept in a single
+    // registry for the whole process. A plan is created by find_plan on first
+    // use and lives until destroy_plans or the end of the program.*
+    API fft_plan_t& find_plan(uint n, fft_type_t type, uint threads);
+    API void destroy_plans();
+
+    // *Planner rigor of the registry and of the plans owned by the impedance
+    // objects: FFTW_ESTIMATE (default), FFTW_MEASURE or FFTW_PATIENT.
+    // FFTW_DESTROY_INPUT is always added. Only plans created afterwards are
+    // affected*
+    API void set_planner_flags(uint flags);
+    API uint planner_flags();
+
+    // *Wisdom file imported at once and exported again by export_wisdom and
+    // at the end of the program, so that measured plans are free on the next
+    // run. Returns false if the file could not be read*
+    API bool set_wisdom_file(const std::string& file);
+    API bool export_wisdom();
+
+    // The FFTW planner is not thread safe, plans are created and destroyed
+    // under this lock
+    API std::mutex& planner_mutex();
+
+    // *Threads of a transform of size n for a caller asking for requested
+    // threads. The request is capped by the OpenMP threads available and by
+    // n over the elements per thread of the transform type. It is 1 without
+    // USE_FFTW_OMP and inside an active OpenMP parallel region, so FFTW never
+    // oversubscribes the cores and small transforms run serially next to
+    // the other OpenMP work. Plans are kept per resulting thread count*
+    API uint fft_threads(uint n, fft_type_t type, uint requested);
+
+    // Threads asked for by the library code, Context::n_threads
+    API uint default_threads();
+
+    // *Crossover of the policy above: a transform gets one more thread per
+    // elems points. FFT and IFFT share one value, RFFT and IRFFT another*
+    API void set_elems_per_thread(fft_type_t type, uint elems);
+    API uint elems_per_thread(fft_type_t type);
+
+    // *Measures the crossovers on this machine: for doubling sizes up to
+    // maxSize, the first size where two threads beat one sets the elements
+    // per thread to half of it. Returns false, changing nothing, without
+    // USE_FFTW_OMP or with a single OpenMP thread*
+    API bool measure_thread_crossovers(uint maxSize = 1 << 20);
+
+    // *Smallest 2-3-5-smooth number larger than target*
+    API uint next_regular(uint target);
+
+    // *Padded FFT size for a signal of target points, larger than target.
+    // Without size tuning it is next_regular(target). With size tuning the
+    // even 2-3-5-7-11-smooth candidates up to the next power of two are
+    // timed once on this machine with the current planner flags and the
+    // threads fft_threads gives the target, and the fastest one is kept for
+    // the rest of the run for these flags and threads*
+    API uint good_size(uint target);
+
+    // *Enables or disables size tuning. The tuned sizes are read from
+    // cacheFile, if given, and every new result is appended to it as a line
+    // "target flags threads size", so that a machine only tunes a size once
+    // per configuration. Returns false if the file could not be read*
+    API bool set_size_tuning(bool enable, const std::string& cacheFile = "");
 
     static inline void real_to_complex(const std::vector<ftype>& in,
                                        std::vector<complex_t>& out) {
@@ -88,13 +155,10 @@ namespace fft {
                                      const int sign = FFTW_FORWARD,
                                      const unsigned flag = FFTW_ESTIMATE,
                                      const int threads = 1) {
+        std::lock_guard<std::mutex> guard(planner_mutex());
 #ifdef USE_FFTW_OMP
-        if (threads > 1) {
-            fftw_init_threads();
-            fftw_plan_with_nthreads(std::min(
-                threads,
-                (int)((n + ELEMS_PER_THREAD_FFT - 1) / ELEMS_PER_THREAD_FFT)));
-        }
+        fftw_plan_with_nthreads(
+            fft_threads(n, sign == FFTW_FORWARD ? FFT : IFFT, threads));
 #endif
         fftw_complex *a, *b;
         a = reinterpret_cast<fftw_complex*>(in);
@@ -104,16 +168,10 @@ namespace fft {
 
     static inline fftw_plan init_rfft(const int n, ftype* in, complex_t* out,
                                       const unsigned flag = FFTW_ESTIMATE,
-                                      const int threads = 1)
-
-    {
+                                      const int threads = 1) {
+        std::lock_guard<std::mutex> guard(planner_mutex());
 #ifdef USE_FFTW_OMP
-        if (threads > 1) {
-            fftw_init_threads();
-            fftw_plan_with_nthreads(
-                std::min(threads, (int)((n + ELEMS_PER_THREAD_RFFT - 1) /
-                                        ELEMS_PER_THREAD_RFFT)));
-        }
+        fftw_plan_with_nthreads(fft_threads(n, RFFT, threads));
 #endif
         fftw_complex* b;
         b = reinterpret_cast<fftw_complex*>(out);
@@ -123,116 +181,40 @@ namespace fft {
     static inline fftw_plan init_irfft(const int n, complex_t* in, ftype* out,
                                        const unsigned flag = FFTW_ESTIMATE,
                                        const int threads = 1) {
+        std::lock_guard<std::mutex> guard(planner_mutex());
 #ifdef USE_FFTW_OMP
-        if (threads > 1) {
-            fftw_init_threads();
-            fftw_plan_with_nthreads(std::min(
-                threads,
-                (int)((n + ELEMS_PER_THREAD_FFT - 1) / ELEMS_PER_THREAD_FFT)));
-        }
+        fftw_plan_with_nthreads(fft_threads(n, IRFFT, threads));
 #endif
         fftw_complex* b;
         b = reinterpret_cast<fftw_complex*>(in);
         return fftw_plan_dft_c2r_1d(n, b, out, flag);
     }
 
-    static inline void run_fft(const fftw_plan& p) { fftw_execute(p); }
+    // Plan of howmany inverse real transforms of size n, on contiguous
+    // rows of n/2+1 complex inputs and n real outputs
+    static inline fftw_plan init_many_irfft(const int n, const int howmany,
+                                            complex_t* in, ftype* out,
+                                            const unsigned flag = FFTW_ESTIMATE,
+                                            const int threads = 1) {
+        std::lock_guard<std::mutex> guard(planner_mutex());
+#ifdef USE_FFTW_OMP
+        fftw_plan_with_nthreads(fft_threads(howmany * n, IRFFT, threads));
+#endif
+        fftw_complex* b;
+        b = reinterpret_cast<fftw_complex*>(in);
+        return fftw_plan_many_dft_c2r(1, &n, howmany, b, NULL, 1, n / 2 + 1,
+                                      out, NULL, 1, n, flag);
+    }
 
-    static inline void destroy_fft(fftw_plan& p) { fftw_destroy_plan(p); }
+    static inline void run_fft(const fftw_plan& p) { fftw_execute(p); }
 
-    static inline void destroy_plans() {
-        // std::cout<<"planV size = " << planV.size()<<"\n";
-        for (auto& i : planV) {
-            fftw_destroy_plan(i.p);
-            fftw_free(i.in);
-            fftw_free(i.out);
-        }
-        planV.clear();
+    static inline void destroy_fft(fftw_plan& p) {
+        std::lock_guard<std::mutex> guard(planner_mutex());
+        fftw_destroy_plan(p);
     }
 
     //#endif
 
-    static inline fft_plan_t find_plan(uint n, fft_type_t type, uint threads,
-                                       std::vector<fft_plan_t>& v) {
-        const uint flag = FFTW_FLAGS;
-        auto it =
-            std::find_if(v.begin(), v.end(), [n, type](const fft_plan_t& s) {
-                return ((s.n == n) && (s.type == type));
-            });
-
-        /*
-        auto it = v.begin();
-        for(it = v.begin(); it != v.end(); ++it){
-           if(it->n == n && it->type == type)
-              break;
-        }
-        */
-        if (it == v.end()) {
-            // std::cout << "I have to create a new plan :(\n";
-            fft_plan_t plan;
-            plan.n = n;
-            plan.type = type;
-
-            if (type == FFT) {
-                fftw_complex* in =
-                    (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
-                fftw_complex* out =
-                    (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
-
-                auto p = init_fft(n, reinterpret_cast<complex_t*>(in),
-                                  reinterpret_cast<complex_t*>(out),
-                                  FFTW_FORWARD, flag, threads);
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-            } else if (type == IFFT) {
-
-                fftw_complex* in =
-                    (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
-                fftw_complex* out =
-                    (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
-                auto p = init_fft(n, reinterpret_cast<complex_t*>(in),
-                                  reinterpret_cast<complex_t*>(out),
-                                  FFTW_BACKWARD, flag, threads);
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-
-            } else if (type == RFFT) {
-                ftype* in = (ftype*)fftw_malloc(sizeof(ftype) * n);
-                fftw_complex* out = (fftw_complex*)fftw_malloc(
-                    sizeof(fftw_complex) * (n / 2 + 1));
-                auto p = init_rfft(n, in, reinterpret_cast<complex_t*>(out),
-                                   flag, threads);
-                // std::cout << "threads : " << threads << "\n";
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-
-            } else if (type == IRFFT) {
-                ftype* out = (ftype*)fftw_malloc(sizeof(ftype) * n);
-                fftw_complex* in = (fftw_complex*)fftw_malloc(
-                    sizeof(fftw_complex) * (n / 2 + 1));
-                auto p = init_irfft(n, reinterpret_cast<complex_t*>(in), out,
-                                    flag, threads);
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-
-            } else {
-                std::cerr << "[fft::find_plan]: ERROR "
-                          << "Wrong fft type!\n";
-                exit(-1);
-            }
-
-            v.push_back(plan);
-            // planV.push_back(plan);
-            return plan;
-        } else {
-            return *it;
-        }
-    }
-
     // Parameters are like python's numpy.fft.rfft
     // @in:  input data
     // @n:   number of points to use. If n < in.size() then the input is cropped
@@ -247,7 +229,8 @@ namespace fft {
 
         out.resize(n / 2 + 1);
 
-        auto plan = fft::find_plan(n, RFFT, threads, planV);
+        auto& plan = fft::find_plan(n, RFFT, threads);
+        std::lock_guard<std::mutex> guard(plan.lock);
         auto* from = (ftype*)plan.in;
         auto* to = (complex_t*)plan.out;
 
@@ -270,7 +253,8 @@ namespace fft {
 
         out.resize(n);
 
-        auto plan = fft::find_plan(n, FFT, threads, planV);
+        auto& plan = fft::find_plan(n, FFT, threads);
+        std::lock_guard<std::mutex> guard(plan.lock);
         auto* from = (complex_t*)plan.in;
         auto* to = (complex_t*)plan.out;
 
@@ -293,7 +277,8 @@ namespace fft {
 
         out.resize(n);
 
-        auto plan = fft::find_plan(n, IFFT, threads, planV);
+        auto& plan = fft::find_plan(n, IFFT, threads);
+        std::lock_guard<std::mutex> guard(plan.lock);
         auto* from = (complex_t*)plan.in;
         auto* to = (complex_t*)plan.out;
         std::copy(in.begin(), in.end(), from);
@@ -308,13 +293,14 @@ namespace fft {
     // @in: input vector which must be the result of a rfft
     // @out: irfft of input, always real
     // Missing n: size of output
-    static inline void irfft(complex_vector_t in, f_vector_t& out, uint n = 0,
-                             const uint threads = 1) {
+    static inline void irfft(const complex_vector_t& in, f_vector_t& out,
+                             uint n = 0, const uint threads = 1) {
         n = (n == 0) ? 2 * (in.size() - 1) : n;
         // std::cout << "out size will be " << n << "\n";
         out.resize(n);
 
-        auto plan = fft::find_plan(n, IRFFT, threads, planV);
+        auto& plan = fft::find_plan(n, IRFFT, threads);
+        std::lock_guard<std::mutex> guard(plan.lock);
         auto* from = (complex_t*)plan.in;
         auto* to = (ftype*)plan.out;
 
@@ -326,6 +312,159 @@ namespace fft {
                        std::bind2nd(std::divides<ftype>(), n));
     }
 
+    // *Allocator of fftw_malloc memory. Vectors using it have the alignment
+    // of the registry plans, so the transforms below never fall back to
+    // copying them*
+    template <typename T> struct fftw_allocator {
+        typedef T value_type;
+        fftw_allocator() {}
+        template <typename U> fftw_allocator(const fftw_allocator<U>&) {}
+        T* allocate(std::size_t n) {
+            T* p = static_cast<T*>(fftw_malloc(n * sizeof(T)));
+            if (p == NULL)
+                throw std::bad_alloc();
+            return p;
+        }
+        void deallocate(T* p, std::size_t) { fftw_free(p); }
+    };
+    template <typename T, typename U>
+    bool operator==(const fftw_allocator<T>&, const fftw_allocator<U>&) {
+        return true;
+    }
+    template <typename T, typename U>
+    bool operator!=(const fftw_allocator<T>&, const fftw_allocator<U>&) {
+        return false;
+    }
+    typedef std::vector<ftype, fftw_allocator<ftype>> aligned_f_vector_t;
+    typedef std::vector<complex_t, fftw_allocator<complex_t>>
+        aligned_complex_vector_t;
+
+    // *Transforms of size n on caller-owned buffers, executed with the
+    // registry plans through FFTW's new-array execute: once the plan exists
+    // nothing is copied or allocated and the calls may run concurrently.
+    // Unlike ifft and irfft the inverse transforms are not normalised, the
+    // caller folds 1/n into its own scaling. The input may be overwritten.
+    // Buffers aligned differently from fftw_malloc memory, as required by
+    // FFTW, are transformed through the plan's own buffers instead*
+    static inline bool same_alignment(const fft_plan_t& plan, const void* in,
+                                      const void* out) {
+        return fftw_alignment_of((double*)in) ==
+                   fftw_alignment_of((double*)plan.in) &&
+               fftw_alignment_of((double*)out) ==
+                   fftw_alignment_of((double*)plan.out);
+    }
+
+    template <typename In, typename Out>
+    static inline void copy_execute(fft_plan_t& plan, const In* in,
+                                    const uint inSize, Out* out,
+                                    const uint outSize) {
+        std::lock_guard<std::mutex> guard(plan.lock);
+        std::copy(in, in + inSize, (In*)plan.in);
+        run_fft(plan.p);
+        std::copy((Out*)plan.out, (Out*)plan.out + outSize, out);
+    }
+
+    // @in: n real values, @out: n/2+1 complex values
+    static inline void execute_rfft(const uint n, ftype* in, complex_t* out,
+                                    const uint threads = 1) {
+        auto& plan = fft::find_plan(n, RFFT, threads);
+        if (same_alignment(plan, in, out))
+            fftw_execute_dft_r2c(plan.p, in,
+                                 reinterpret_cast<fftw_complex*>(out));
+        else
+            copy_execute(plan, in, n, out, n / 2 + 1);
+    }
+
+    // @in: n/2+1 complex values, @out: n real values, n times the irfft
+    static inline void execute_irfft(const uint n, complex_t* in, ftype* out,
+                                     const uint threads = 1) {
+        auto& plan = fft::find_plan(n, IRFFT, threads);
+        if (same_alignment(plan, in, out))
+            fftw_execute_dft_c2r(plan.p, reinterpret_cast<fftw_complex*>(in),
+                                 out);
+        else
+            copy_execute(plan, in, n / 2 + 1, out, n);
+    }
+
+    // @in, @out: n complex values, the inverse is n times the ifft
+    static inline void execute_fft(const uint n, complex_t* in, complex_t* out,
+                                   const bool inverse = false,
+                                   const uint threads = 1) {
+        auto& plan = fft::find_plan(n, inverse ? IFFT : FFT, threads);
+        if (same_alignment(plan, in, out))
+            fftw_execute_dft(plan.p, reinterpret_cast<fftw_complex*>(in),
+                             reinterpret_cast<fftw_complex*>(out));
+        else
+            copy_execute(plan, in, n, out, n);
+    }
+
+    // *Convolution engine on real transforms of fixed size fSize, owning
+    // aligned buffers and running the registry plans on them: after
+    // construction a convolution does no allocation or copy besides the
+    // input and output. Inputs are zero padded to fSize, so the convolution is
+    // linear as long as signal and kernel together are at most fSize + 1
+    // samples long, and circular beyond. The kernel is transformed once by
+    // set_kernel and used for any number of signals. The products of the
+    // spectra are fused with the scaling, including the 1/fSize of the
+    // inverse transform*
+    class API FftConvolver {
+      public:
+        const uint fSize;
+
+        FftConvolver(uint size, uint threads = 1);
+        ~FftConvolver();
+        FftConvolver(const FftConvolver&) = delete;
+        FftConvolver& operator=(const FftConvolver&) = delete;
+
+        // Transforms and keeps the kernel of len samples
+        void set_kernel(const ftype* kernel, uint len);
+        // Keeps spectrum, fSize/2+1 values, as the spectrum of the kernel
+        void set_kernel_spectrum(const complex_t* spectrum);
+        const complex_t* kernel_spectrum() const { return fKernel; }
+
+        // res[0..resLen) = factor * (signal * kernel), signal of len samples
+        template <typename T>
+        void convolve(const T* signal, uint len, ftype* res, uint resLen,
+                      ftype factor = 1) {
+            forward(signal, len);
+            product(fKernel, fSpectrum, factor, false);
+            inverse(res, resLen);
+        }
+
+        // res[m] = factor * sum_i signal[i + m] * kernel[i], m < resLen
+        template <typename T>
+        void correlate(const T* signal, uint len, ftype* res, uint resLen,
+                       ftype factor = 1) {
+            forward(signal, len);
+            product(fKernel, fSpectrum, factor, true);
+            inverse(res, resLen);
+        }
+
+        // res[0..resLen) = factor * irfft(a * b), for spectra of fSize/2+1
+        // values computed elsewhere
+        void inverse_product(const complex_t* a, const complex_t* b,
+                             ftype* res, uint resLen, ftype factor = 1);
+
+      private:
+        ftype* fReal;
+        complex_t* fSpectrum;
+        complex_t* fKernel;
+        // Threads of the registry plans executed on the buffers above
+        const uint fThreads;
+
+        template <typename T> void forward(const T* signal, uint len) {
+            len = std::min(len, fSize);
+            std::copy(signal, signal + len, fReal);
+            std::fill(fReal + len, fReal + fSize, 0);
+            forward_execute();
+        }
+        void forward_execute();
+        // fSpectrum = factor / fSize * a * b, or conj(a) * b
+        void product(const complex_t* a, const complex_t* b, ftype factor,
+                     bool conjugate);
+        void inverse(ftype* res, uint resLen);
+    };
+
     // Same as python's numpy.fft.rfftfreq
     // @ n: window length
     // @ d (optional) : Sample spacing
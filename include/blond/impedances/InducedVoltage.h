@@ -8,11 +8,22 @@
 #ifndef IMPEDANCES_INDUCEDVOLTAGE_H_
 #define IMPEDANCES_INDUCEDVOLTAGE_H_
 
+#include <blond/beams/Slices.h>
 #include <blond/configuration.h>
+#include <blond/fft.h>
 #include <blond/impedances/Intensity.h>
 #include <vector>
 
-enum time_or_freq { time_domain, freq_domain };
+// auto_domain uses whichever of the two is faster for the slicing
+enum time_or_freq { time_domain, freq_domain, auto_domain };
+
+// Parts of the slicing that changed since an object was last processed
+enum slicing_change_t {
+    no_change = 0,
+    offset_change = 1,
+    spacing_change = 2,
+    size_change = 4
+};
 
 typedef enum freq_res_option_t {
     round_option,
@@ -23,6 +34,8 @@ typedef enum freq_res_option_t {
 class API InducedVoltage {
   public:
     std::vector<ftype> fInducedVoltage;
+    // Slices::frame_version this object was last processed for
+    uint fFrameVersion = 0;
 
     InducedVoltage(){};
     inline void linear_interp_kick(const ftype* __restrict beam_dt,
@@ -32,10 +45,53 @@ class API InducedVoltage {
                                    const int n_slices,
                                    const int n_macroparticles,
                                    const ftype acc_kick = 0.0);
+    inline void linear_interp_kick(const int* __restrict bin_index,
+                                   const ftype* __restrict bin_fraction,
+                                   ftype* __restrict beam_dE,
+                                   const ftype* __restrict voltage_array,
+                                   const int n_slices,
+                                   const int n_macroparticles,
+                                   const ftype acc_kick = 0.0);
+    void induced_voltage_kick(const ftype* __restrict voltage_array,
+                              const ftype acc_kick = 0.0);
+    void follow_frame();
+    // Makes the next reprocess rebuild everything, needed after a change of
+    // the sources since reprocess only follows changes of the slicing
+    virtual void invalidate() { fSlicingSize = 0; }
+    // Adds the multi-turn impedance of this object to impedance, sampled as
+    // in TotalInducedVoltage::track_memory. Returns false for objects
+    // without memory, which are summed turn by turn instead.
+    virtual bool add_impedance_memory(complex_vector_t& impedance) {
+        return false;
+    }
+    // Adds the wake of the sources of this object, sampled at time, to wake
+    virtual void add_wake(const f_vector_t& time, f_vector_t& wake) {}
+    // True if add_wake gives the whole wake of this object
+    virtual bool has_wake() { return false; }
+    // Number of FFT points of the beam spectrum that the impedance of
+    // add_impedance multiplies, 0 for objects without such an impedance
+    virtual uint impedance_sampling() { return 0; }
+    // Number of FFT points of the beam spectrum multiplied with
+    // add_impedance, or 0 if TotalInducedVoltage cannot merge this object
+    // with others sharing the same spectrum
+    virtual uint merged_sampling() { return 0; }
+    virtual void add_impedance(complex_vector_t& impedance) {}
+    // True for purely inductive objects, whose voltage has no wake
+    virtual bool inductive() { return false; }
     virtual void track() = 0;
     virtual void reprocess() = 0;
     virtual std::vector<ftype> induced_voltage_generation(uint length = 0) = 0;
     virtual ~InducedVoltage(){};
+
+  protected:
+    // Number of slices, bin spacing and first bin center of the slicing
+    // this object was last processed for
+    uint fSlicingSize = 0;
+    ftype fSlicingSpacing = 0;
+    ftype fSlicingOffset = 0;
+    // Records the current slicing and returns the slicing_change_t bits of
+    // what differs from the previous record
+    uint slicing_changes();
 };
 
 class API InducedVoltageTime : public InducedVoltage {
@@ -45,16 +101,27 @@ class API InducedVoltageTime : public InducedVoltage {
     std::vector<ftype> fTotalWake;
     uint fCut;
     uint fShape;
+    // *May be changed between turns, the wake spectrum is then generated on
+    // the first freq_domain turn*
     time_or_freq fTimeOrFreq;
 
     void track();
     void sum_wakes(std::vector<ftype>& v);
+    void wake_spectrum_generation();
+    void add_wake(const f_vector_t& time, f_vector_t& wake);
+    bool has_wake() { return true; }
     void reprocess();
     std::vector<ftype> induced_voltage_generation(uint length = 0);
     InducedVoltageTime(std::vector<Intensity*>& WakeSourceList,
                        time_or_freq TimeOrFreq = freq_domain);
 
     ~InducedVoltageTime();
+
+  private:
+    // Set for auto_domain, fTimeOrFreq is then chosen on every reprocess
+    bool fAutoDomain = false;
+    // Convolution of size fShape with the wake for freq_domain
+    fft::FftConvolver* fConvolver = NULL;
 };
 
 class API InducedVoltageFreq : public InducedVoltage {
@@ -71,6 +138,13 @@ class API InducedVoltageFreq : public InducedVoltage {
     // calculation.*
     uint fNTurnsMem;
     bool fRecalculationImpedance;
+    // *With fRecalculationImpedance, the impedance is recalculated every
+    // fRecalcPeriod turns (never if 0), or as soon as the slice spacing or
+    // the revolution frequency moved by more than fRecalcTolerance
+    // (relative, disabled if 0) since the last recalculation. In between,
+    // the last impedance is interpolated on the current frequencies*
+    uint fRecalcPeriod = 1;
+    ftype fRecalcTolerance = 0;
     bool fSaveIndividualVoltages;
     // *Real frequency resolution in [Hz], according to the obtained
     // n_fft_sampling.*
@@ -81,6 +155,8 @@ class API InducedVoltageFreq : public InducedVoltage {
     freq_res_option_t fFreqResOption;
     // *Total impedance array of all sources in* [:math:`\Omega`]
     complex_vector_t fTotalImpedance;
+    // *Impedance [source x frequency] and induced voltage [source x slice]
+    // of every source, stored row by row*
     complex_vector_t fMatrixSaveIndividualImpedances;
     f_vector_t fMatrixSaveIndividualVoltages;
 
@@ -97,6 +173,13 @@ class API InducedVoltageFreq : public InducedVoltage {
 
     void track();
     void sum_impedances(f_vector_t&);
+    // Samples the impedance over fNTurnsMem+1 turns for the memory mode
+    void sum_impedances_memory();
+    bool add_impedance_memory(complex_vector_t& impedance);
+    uint impedance_sampling() { return fNFFTSampling; }
+    uint merged_sampling();
+    void add_impedance(complex_vector_t& impedance);
+    void impedance_recalculation();
 
     // Reprocess the impedance contributions with respect to the new_slicing.
     void reprocess();
@@ -108,6 +191,74 @@ class API InducedVoltageFreq : public InducedVoltage {
         uint NTurnsMem = 0, bool recalculationImpedance = false,
         bool saveIndividualVoltages = false);
     ~InducedVoltageFreq();
+
+  private:
+    // Inverse FFT of the product of impedance and beam spectrum
+    fft::FftConvolver* fConvolver = NULL;
+    void time_array_memory_generation();
+    // Batched inverse FFT of all the sources for fSaveIndividualVoltages
+    uint fPlanSize = 0;
+    complex_t* fIndividualSpectra = NULL;
+    ftype* fIndividualVoltages = NULL;
+    fftw_plan fIndividualPlan;
+    void individual_plan_generation();
+
+    // Turn, slice spacing, revolution frequency and impedances of the last
+    // recalculation
+    int fRecalcTurn = -1;
+    ftype fRecalcSpacing = 0;
+    ftype fRecalcFRev = 0;
+    complex_vector_t fRecalcImpedance;
+    complex_vector_t fRecalcIndividualImpedances;
+    // Slice spacing fTotalImpedance is currently sampled for
+    ftype fAppliedSpacing = 0;
+};
+
+class API InducedVoltageResonator : public InducedVoltage {
+  public:
+    // *Resonators evaluated recursively along the slices: the wake of a
+    // resonator is Re(C * exp((-alpha + i*omega_bar) * t)), so its
+    // convolution with the profile needs one complex state per resonator*
+    Resonators* fResonators;
+    // *Carry the wake of the previous turns to the current one*
+    bool fMultiTurnMemory;
+    // *State of every resonator at the first bin of the next turn*
+    complex_vector_t fMemoryState;
+
+    void track();
+    void reprocess();
+    void add_wake(const f_vector_t& time, f_vector_t& wake);
+    bool has_wake() { return true; }
+    std::vector<ftype> induced_voltage_generation(uint length = 0);
+    InducedVoltageResonator(Resonators* resonators,
+                            bool multiTurnMemory = false);
+    ~InducedVoltageResonator();
+
+  private:
+    // Per resonator: the step exp((-alpha + i*omega_bar) * dt), the wake
+    // coefficient C, the wake at zero R*alpha and the complex frequency
+    complex_vector_t fStep;
+    complex_vector_t fCoefficient;
+    f_vector_t fWakeZero;
+    complex_vector_t fExponent;
+    complex_vector_t fStartState;
+    int fMemoryTurn = -1;
+};
+
+class API InductiveImpedance : public InducedVoltage {
+  public:
+    // *Constant imaginary Z/n in [Ohm], one value or one per turn*
+    f_vector_t fZOverN;
+    // *Method used for the derivative of the profile*
+    derivative_type fDerivMode;
+
+    void track();
+    void reprocess(){};
+    bool inductive() { return true; }
+    std::vector<ftype> induced_voltage_generation(uint length = 0);
+    InductiveImpedance(const f_vector_t& ZOverN,
+                       derivative_type derivMode = gradient_derivative);
+    ~InductiveImpedance(){};
 };
 
 class API TotalInducedVoltage : public InducedVoltage {
@@ -119,11 +270,39 @@ class API TotalInducedVoltage : public InducedVoltage {
     uint fNTurnsMemory;
     bool fInductiveImpedanceOn = false;
 
+    // *Memory mode: induced voltage of the current and the following
+    // fNTurnsMemory turns, shifted by one revolution period every turn,
+    // fRevTimeArray[turn] or beyond its end GeneralParameters::t_rev*
+    uint fLenArrayMemory = 0;
+    uint fNPointsFFT = 0;
+    f_vector_t fVoltageMemory;
+    f_vector_t fFreqArrayMemory;
+    complex_vector_t fTotalImpedanceMemory;
+
+    // *Ghost bunches: the simulated bunch stands for the last bunch of a
+    // train of identical bunches every fGhostSpacing [s]. Each of the
+    // fNGhostBunches trailing bunches of the train feels the wake of the
+    // bunches ahead of it, so the whole train is represented by the last
+    // one, which feels the wake of fNGhostBunches copies preceding it. The
+    // coupling is computed once: for the objects with a wake it is stored
+    // per bin lag in fGhostWake, for InducedVoltageFreq objects it is their
+    // impedance times the phase shifts of the ghosts. Other objects, and
+    // the memory mode, are rejected by set_ghost_bunches*
+    uint fNGhostBunches = 0;
+    ftype fGhostSpacing = 0;
+    f_vector_t fGhostWake;
+
     void track();
     void track_memory();
+    void impedance_memory_generation();
+    void merge_impedances();
+    void set_ghost_bunches(uint NGhostBunches, ftype GhostSpacing);
+    void ghost_wake_generation();
+    const f_vector_t& ghost_voltage_generation();
     void track_ghosts_particles();
     std::vector<ftype> induced_voltage_sum(uint length = 0);
     void reprocess();
+    void invalidate();
 
     std::vector<ftype> induced_voltage_generation(uint length = 0) {
         return std::vector<ftype>();
@@ -134,6 +313,47 @@ class API TotalInducedVoltage : public InducedVoltage {
                         std::vector<ftype> RevTimeArray = std::vector<ftype>());
 
     ~TotalInducedVoltage();
+
+  private:
+    // Objects without memory, summed on top of the memory every turn
+    std::vector<InducedVoltage*> fShortRangeList;
+    // InducedVoltageFreq objects sharing a beam spectrum are summed as one
+    // impedance per sampling; the rest are generated one by one. The merged
+    // objects are not generated, so their own fInducedVoltage is not
+    // updated by TotalInducedVoltage, only the total one is
+    std::vector<uint> fMergedSampling;
+    std::vector<complex_vector_t> fMergedImpedance;
+    std::vector<InducedVoltage*> fUnmergedList;
+    // Spectrum and voltage of the inverse FFT of the merged impedances, in
+    // FFTW aligned memory
+    fft::aligned_complex_vector_t fSpectrumBuffer;
+    fft::aligned_f_vector_t fVoltageBuffer;
+    // Ghost bunches: number of slices of the coupling, convolution with
+    // fGhostWake and the buffers of the profile, of the convolution and of
+    // the ghost voltage
+    uint fGhostSlices = 0;
+    bool fGhostDirect = true;
+    fft::FftConvolver* fGhostConvolver = NULL;
+    f_vector_t fGhostProfile;
+    f_vector_t fGhostBuffer;
+    f_vector_t fGhostVoltage;
+    // and per beam spectrum sampling of the InducedVoltageFreq objects, the
+    // phase shifts sum_k exp(2 pi i f k fGhostSpacing) of the ghosts and
+    // the inverse FFT of their product with the impedances
+    std::vector<uint> fGhostSampling;
+    std::vector<complex_vector_t> fGhostPhase;
+    std::vector<fft::FftConvolver*> fGhostInverse;
+    complex_vector_t fGhostImpedance;
+    void ghost_clear();
+    // Work buffers and plans of size fNPointsFFT for track_memory
+    uint fPlanSize = 0;
+    ftype* fMemoryPadded = NULL;
+    complex_t* fMemorySpectrum = NULL;
+    complex_t* fProfileSpectrum = NULL;
+    fftw_plan fMemoryPlan;
+    fftw_plan fMemoryInversePlan;
+    fftw_plan fProfilePlan;
+    fftw_plan fProfileInversePlan;
 };
 
 #endif /* IMPEDANCES_INDUCEDVOLTAGE_H_ */
\ No newline at end of file
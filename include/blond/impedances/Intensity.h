@@ -24,11 +24,37 @@ class API Intensity {
     f_vector_t fWake;
     //  *Impedance array in* [:math:`\Omega`]
     complex_vector_t fImpedance;
+    //  *Number of impedance spectra kept by imped_calc, 0 disables caching*
+    uint fImpedanceCacheSize = 4;
 
     Intensity(){};
     virtual void wake_calc(const f_vector_t& NewTimeArray) = 0;
     virtual void imped_calc(const f_vector_t& NewFrequencyArray) = 0;
+    // *To be called after the source parameters are modified, so that
+    // imped_calc does not serve spectra of the old parameters. Resonators
+    // check their parameters at every imped_calc and do not need it; an
+    // InputTable is too large to be hashed at every call*
+    void parameters_changed();
     virtual ~Intensity(){};
+
+  protected:
+    // Spectra evaluated on uniform grids, most recently used first. A
+    // spectrum is identified by the start, step and length of the grid and
+    // the hash of the parameters, computed when they are set
+    struct ImpedanceCacheEntry {
+        ftype start;
+        ftype step;
+        uint length;
+        size_t hash;
+        complex_vector_t impedance;
+    };
+    std::vector<ImpedanceCacheEntry> fImpedanceCache;
+    size_t fParametersHash = 0;
+
+    bool impedance_from_cache(const f_vector_t& freq);
+    void impedance_to_cache(const f_vector_t& freq);
+    virtual size_t parameters_hash() const = 0;
+    static size_t hash_vector(const f_vector_t& v, size_t seed = 0);
 };
 
 class API Resonators : public Intensity {
@@ -47,6 +73,9 @@ class API Resonators : public Intensity {
     void imped_calc(const f_vector_t& NewFrequencyArray);
     Resonators(f_vector_t& RS, f_vector_t& FrequencyR, f_vector_t& Q);
     ~Resonators();
+
+  protected:
+    size_t parameters_hash() const;
 };
 
 class API InputTable : public Intensity {
@@ -56,12 +85,22 @@ class API InputTable : public Intensity {
     f_vector_t fImZArrayLoaded;
     complex_vector_t fImpedanceLoaded;
     f_vector_t fWakeArray;
+    //  *Relative rms error of the last fit_resonators*
+    ftype fFitError = 0;
 
     void wake_calc(const f_vector_t& NewTimeArray);
     void imped_calc(const f_vector_t& NewFrequencyArray);
+    // *Approximates the loaded impedance by a sum of resonators, added one
+    // at a time until the relative rms error is below tolerance. The
+    // caller owns the returned Resonators*
+    Resonators* fit_resonators(ftype tolerance = 1e-2,
+                               uint maxResonators = 32);
     InputTable(const f_vector_t& input1, const f_vector_t& input2,
                const f_vector_t input3 = f_vector_t());
     ~InputTable();
+
+  protected:
+    size_t parameters_hash() const;
 };
 
 #endif /* IMPEDANCES_INTENSITY_H_ */
@@ -38,6 +38,37 @@ class API PhaseLoop {
     PhaseNoise* RFnoise;
     LHCNoiseFB* noiseFB;
     virtual ~PhaseLoop(){};
+
+    // *When set, beam_phase uses the sums of the sine and cosine of the RF
+    // phase of every particle, weighted by the window exp(alpha dt), which
+    // the RF kick of RingAndRfSection accumulates for the next turn. The
+    // phase loop then needs no slices, and the estimate lags the sliced one
+    // by the drift of one turn. Without sums from the last kick, as on the
+    // first turn or with periodicity, the slices are used. With a window,
+    // alpha != 0, the kick evaluates an exp per particle*
+    bool particle_phase = false;
+    void set_particle_sums(ftype sin_sum, ftype cos_sum);
+
+    // *When set, the drift of RingAndRfSection sums the energy of the
+    // particles it leaves inside the frame of the bin centers, and the next
+    // radial_difference uses that sum instead of reading the beam again.
+    // Without a sum from the last drift, radial_difference reads the stored
+    // bins of the slicing if they are valid, and dt otherwise*
+    bool drift_radial = false;
+    void set_radial_sums(ftype dE_sum, uint n_inside);
+
+  private:
+    ftype particle_sin = 0;
+    ftype particle_cos = 0;
+    bool particle_sums = false;
+    ftype radial_dE_sum = 0;
+    uint radial_n_inside = 0;
+    bool radial_sums = false;
+    // Window function of beam_phase times the trapezoid weights of the bin
+    // centers, kept with the bin centers and alpha it was computed for
+    f_vector_t window;
+    f_vector_t window_bin_centers;
+    ftype window_alpha = 0;
 };
 
 class API LHC : public PhaseLoop {
@@ -11,54 +11,110 @@
 #include <algorithm>
 #include <blond/configuration.h>
 #include <blond/fft.h>
-#include <blond/sin.h>
+#include <blond/sin_kernels.h>
 #include <blond/utilities.h>
 #include <cmath>
 #include <omp.h>
 
 namespace mymath {
 
-    // Wrapper function for vdt::fast_sin
-    static inline ftype fast_sin(ftype x) { return vdt::fast_sin(x); }
-
-    static inline ftype fast_cos(ftype x) { return vdt::fast_sin(x + M_PI_2); }
-
     // linear convolution function
+    // The outputs are computed in blocks of 8 kept in registers, against a
+    // copy of the kernel padded with zeros so that the block needs no
+    // bound checks and vectorises
     static inline void convolution(const ftype* __restrict signal,
                                    const int SignalLen,
                                    const ftype* __restrict kernel,
                                    const int KernelLen,
                                    ftype* __restrict res) {
+        if (KernelLen <= 0 || SignalLen <= 0)
+            return;
         const int size = KernelLen + SignalLen - 1;
+        const int B = 8;
+        f_vector_t padded(KernelLen + 2 * (B - 1), 0);
+        std::copy(kernel, kernel + KernelLen, padded.begin() + B - 1);
+        const ftype* __restrict kp = padded.data() + B - 1;
 
 #pragma omp parallel for
-        for (auto n = 0; n < size; ++n) {
-            res[n] = 0;
-            const uint kmin = (n >= KernelLen - 1) ? n - (KernelLen - 1) : 0;
-            const uint kmax = (n < SignalLen - 1) ? n : SignalLen - 1;
-            // uint j = n - kmin;
-            for (uint k = kmin; k <= kmax; k++) {
-                res[n] += signal[k] * kernel[n - k];
-                //--j;
+        for (int n0 = 0; n0 < size; n0 += B) {
+            ftype acc[B] = {0};
+            const int kmin = std::max(0, n0 - (KernelLen - 1));
+            const int kmax = std::min(SignalLen - 1, n0 + B - 1);
+            for (int k = kmin; k <= kmax; ++k) {
+                const ftype s = signal[k];
+                const ftype* __restrict kb = kp + n0 - k;
+                for (int b = 0; b < B; ++b)
+                    acc[b] += s * kb[b];
             }
+            for (int b = 0; b < B && n0 + b < size; ++b)
+                res[n0 + b] = acc[b];
+        }
+    }
+
+    // linear convolution with FFTs of the blocks of the longer input
+    // (overlap-add), the other input is transformed only once
+    static inline void convolution_overlap_add(const ftype* signal,
+                                               int SignalLen,
+                                               const ftype* kernel,
+                                               int KernelLen, ftype* res) {
+        if (KernelLen <= 0 || SignalLen <= 0)
+            return;
+        if (KernelLen > SignalLen) {
+            std::swap(signal, kernel);
+            std::swap(SignalLen, KernelLen);
+        }
+        const int size = KernelLen + SignalLen - 1;
+        uint n = 1;
+        while (n < 4 * (uint)KernelLen) n <<= 1;
+        n = std::min(n, (uint)size);
+        const int block = n - KernelLen + 1;
+
+        fft::FftConvolver convolver(n, fft::default_threads());
+        convolver.set_kernel(kernel, KernelLen);
+
+        f_vector_t out(n);
+        std::fill(res, res + size, 0);
+        for (int start = 0; start < SignalLen; start += block) {
+            const int len = std::min(block, SignalLen - start);
+            convolver.convolve(signal + start, len, out.data(), n);
+            const int end = std::min(size, start + len + KernelLen - 1);
+            for (int i = start; i < end; ++i)
+                res[i] += out[i - start];
         }
     }
 
-    static inline void convolution_with_ffts(f_vector_t signal,
-                                             f_vector_t kernel,
+    enum convolution_method_t { direct_convolution, fft_convolution };
+
+    // The faster convolution method for these lengths, timed on the first
+    // call and cached afterwards. With kernelReused the FFT method is timed
+    // as an FftConvolver of fft::good_size whose kernel is transformed
+    // beforehand, as by the callers that keep one; otherwise as
+    // convolution_overlap_add, setup included
+    API convolution_method_t convolution_method(const int SignalLen,
+                                                const int KernelLen,
+                                                bool kernelReused = false);
+
+    // linear convolution with the faster of the two methods
+    static inline void convolution_auto(const ftype* signal,
+                                        const int SignalLen,
+                                        const ftype* kernel,
+                                        const int KernelLen, ftype* res) {
+        if (convolution_method(SignalLen, KernelLen) == direct_convolution)
+            convolution(signal, SignalLen, kernel, KernelLen, res);
+        else
+            convolution_overlap_add(signal, SignalLen, kernel, KernelLen,
+                                    res);
+    }
+
+    static inline void convolution_with_ffts(const f_vector_t& signal,
+                                             const f_vector_t& kernel,
                                              f_vector_t& res) {
-        complex_vector_t v1; //(signal.size());
-        complex_vector_t v2; //(kernel.size());
         const uint size = signal.size() + kernel.size() - 1;
         res.resize(size);
 
-        fft::rfft(signal, v1, size, omp_get_max_threads());
-        fft::rfft(kernel, v2, size, omp_get_max_threads());
-
-        std::transform(v1.begin(), v1.end(), v2.begin(), v1.begin(),
-                       std::multiplies<complex_t>());
-
-        fft::irfft(v1, res, size, omp_get_max_threads());
+        fft::FftConvolver convolver(size, fft::default_threads());
+        convolver.set_kernel(kernel.data(), kernel.size());
+        convolver.convolve(signal.data(), signal.size(), res.data(), size);
     }
 
     /*
@@ -109,6 +165,80 @@ namespace mymath {
        }
     */
 
+    // Value at x of the segment of xp starting at pos, xp[pos] <= x, or
+    // yp[pos] on the last point
+    template <typename T>
+    static inline T interp_segment(const ftype x, const ftype* xp,
+                                   const T* yp, const uint pos, const uint m) {
+        if (pos + 1 == m)
+            return yp[pos];
+        return yp[pos] + (yp[pos + 1] - yp[pos]) * (x - xp[pos]) /
+                             (xp[pos + 1] - xp[pos]);
+    }
+
+    // *Linear interpolation as numpy.interp of yp, real or complex, known
+    // at the m increasing points xp, on the n points x. Complex values are
+    // interpolated in one pass over both parts. The segment of each point
+    // is found in O(1) if xp is uniformly spaced, by a merge if x is sorted,
+    // and by a binary search otherwise. Large inputs are split in chunks
+    // over the OpenMP threads*
+    template <typename T>
+    static inline void lin_interp(const ftype* __restrict x, const uint n,
+                                  const ftype* __restrict xp,
+                                  const T* __restrict yp, const uint m,
+                                  T* __restrict y, const T left,
+                                  const T right) {
+        if (m == 0) {
+            std::fill(y, y + n, left);
+            return;
+        }
+        const ftype min = xp[0];
+        const ftype max = xp[m - 1];
+
+        // The index from the spacing is only a guess, corrected against xp,
+        // so that rounding in the spacing does not change the results
+        const ftype h = m > 1 ? (max - min) / (m - 1) : 0;
+        bool uniform = h > 0;
+        for (uint i = 1; uniform && i < m; ++i)
+            uniform = std::abs(xp[i] - xp[i - 1] - h) <= 1e-6 * h;
+        const bool sorted = std::is_sorted(x, x + n);
+
+#pragma omp parallel if (n > 10000)
+        {
+            const uint threads = omp_get_num_threads();
+            const uint id = omp_get_thread_num();
+            const uint tile = (n + threads - 1) / threads;
+            const uint start = std::min(id * tile, n);
+            const uint end = std::min(start + tile, n);
+
+            uint pos = 0;
+            for (uint i = start; i < end; ++i) {
+                const ftype a = x[i];
+                if (a < min) {
+                    y[i] = left;
+                    continue;
+                }
+                if (a > max) {
+                    y[i] = right;
+                    continue;
+                }
+                if (uniform) {
+                    pos = std::min((uint)((a - min) / h), m - 1);
+                    while (pos > 0 && xp[pos] > a)
+                        --pos;
+                    while (pos + 1 < m && xp[pos + 1] <= a)
+                        ++pos;
+                } else if (sorted && i > start) {
+                    while (pos + 1 < m && xp[pos + 1] <= a)
+                        ++pos;
+                } else {
+                    pos = std::upper_bound(xp, xp + m, a) - xp - 1;
+                }
+                y[i] = interp_segment(a, xp, yp, pos, m);
+            }
+        }
+    }
+
     // Parameters are like python's np.interp
     // @x: x-coordinates of the interpolated values
     // @xp: The x-coords of the data points
@@ -121,41 +251,23 @@ namespace mymath {
                                   const std::vector<ftype>& yp,
                                   std::vector<ftype>& y, const ftype left = 0.0,
                                   const ftype right = 0.0) {
-        // assert(y.empty());
         assert(xp.size() == yp.size());
-
         y.resize(x.size());
+        lin_interp(x.data(), x.size(), xp.data(), yp.data(), xp.size(),
+                   y.data(), left, right);
+    }
 
-        const uint N = x.size();
-        // const uint M = xp.size();
-        const auto max = xp.back();
-        const auto min = xp.front();
-        const auto end = xp.end();
-        const auto begin = xp.begin();
-
-        uint k = 0;
-        while (x[k] < min && k < N) {
-            y[k] = left;
-            ++k;
-        }
-
-        auto j = begin + k;
-
-        for (uint i = k; i < N; ++i) {
-            if (x[i] > max) {
-                y[i] = right;
-                continue;
-            }
-            j = std::lower_bound(j, end, x[i]);
-            const auto pos = j - begin;
-            if (*j == x[i]) {
-                y[i] = yp[pos];
-            } else {
-                y[i] = yp[pos - 1] +
-                       (yp[pos] - yp[pos - 1]) * (x[i] - xp[pos - 1]) /
-                           (xp[pos] - xp[pos - 1]);
-            }
-        }
+    // As above, for complex values
+    static inline void lin_interp(const std::vector<ftype>& x,
+                                  const std::vector<ftype>& xp,
+                                  const std::vector<complex_t>& yp,
+                                  std::vector<complex_t>& y,
+                                  const complex_t left = 0.0,
+                                  const complex_t right = 0.0) {
+        assert(xp.size() == yp.size());
+        y.resize(x.size());
+        lin_interp(x.data(), x.size(), xp.data(), yp.data(), xp.size(),
+                   y.data(), left, right);
     }
 
     // Function to implement integration of f(x) over the interval
@@ -0,0 +1,135 @@
+/*
+ * sin_kernels.h
+ *
+ *  Sine and cosine kernels of selectable polynomial degree
+ */
+
+#ifndef INCLUDE_BLOND_SIN_KERNELS_H_
+#define INCLUDE_BLOND_SIN_KERNELS_H_
+
+#include <blond/configuration.h>
+#include <blond/sin.h>
+#include <cmath>
+
+// Degree of the sine kernel of the RF kick, see mymath::fast_sin
+#ifndef SIN_KERNEL_DEGREE
+#define SIN_KERNEL_DEGREE 13
+#endif
+
+namespace mymath {
+
+    // *Sine and cosine kernels selected at compile time by the Degree of the
+    // sine polynomial. The argument is reduced to r in [-pi/4, pi/4] and a
+    // quadrant, then sin(r) = r + r^3 P(r^2) and cos(r) = 1 - r^2/2 +
+    // r^4 Q(r^2). P and Q are minimax fits for the relative error on
+    // [-pi/4, pi/4]; the bounds of the polynomials alone are
+    //
+    //   Degree   sin        cos
+    //      7     3.8e-9     1.2e-10
+    //      9     5.2e-12    1.2e-13
+    //     11     5.0e-15    9.3e-17
+    //     13     the vdt kernels, full double precision
+    //
+    // The reduction of degrees 7 to 11 is exact for |x| < 2^20 * pi/2, where
+    // it adds an absolute error of order 1e-16 |x|*
+    template <int Degree>
+    struct sincos_poly;
+
+    template <>
+    struct sincos_poly<7> {
+        static inline ftype sin(const ftype z) {
+            return -1.66666546095484585907e-01 +
+                   z * (8.33216076185236876364e-03 +
+                        z * -1.95152831912836349933e-04);
+        }
+        static inline ftype cos(const ftype z) {
+            return 4.16666456829746969636e-02 +
+                   z * (-1.38873162543206014254e-03 +
+                        z * 2.44331570542127572116e-05);
+        }
+    };
+
+    template <>
+    struct sincos_poly<9> {
+        static inline ftype sin(const ftype z) {
+            return -1.66666666407970461995e-01 +
+                   z * (8.33332930484251438660e-03 +
+                        z * (-1.98393122694444984068e-04 +
+                             z * 2.71812162745736192902e-06));
+        }
+        static inline ftype cos(const ftype z) {
+            return 4.16666666194921389525e-02 +
+                   z * (-1.38888835001398025371e-03 +
+                        z * (2.47994601706927241299e-05 +
+                             z * -2.72057554915813582468e-07));
+        }
+    };
+
+    template <>
+    struct sincos_poly<11> {
+        static inline ftype sin(const ftype z) {
+            return -1.66666666666303507583e-01 +
+                   z * (8.33333332507777223625e-03 +
+                        z * (-1.98412637286334063094e-04 +
+                             z * (2.75553396563111987463e-06 +
+                                  z * -2.47604545571988754504e-08)));
+        }
+        static inline ftype cos(const ftype z) {
+            return 4.16666666665965385570e-02 +
+                   z * (-1.38888888776117861989e-03 +
+                        z * (2.48015807073203330505e-05 +
+                             z * (-2.75555231101985473620e-07 +
+                                  z * 2.06451189168970560622e-09)));
+        }
+    };
+
+    // x = k pi/2 + r, |r| <= pi/4, with pi/2 split in three parts. The
+    // quadrant k mod 4 is kept as a floating point value, so that the loops
+    // over these kernels vectorise
+    static inline ftype reduce_half_pi(const ftype x, ftype& quadrant) {
+        const ftype k = std::floor(x * 0.636619772367581343076 + 0.5);
+        quadrant = k - 4 * std::floor(0.25 * k);
+        return ((x - k * 1.57079632673412561417e+00) -
+                k * 6.07710050630396597660e-11) -
+               k * 2.02226624879595063154e-21;
+    }
+
+    // Both values of the quadrant are computed and one selected, without
+    // branches
+    template <int Degree>
+    static inline void fast_sincos(const ftype x, ftype& s, ftype& c) {
+        ftype q;
+        const ftype r = reduce_half_pi(x, q);
+        const ftype z = r * r;
+        const ftype sr = r + r * z * sincos_poly<Degree>::sin(z);
+        const ftype cr = 1 - 0.5 * z + z * z * sincos_poly<Degree>::cos(z);
+        const bool odd = (q == 1) | (q == 3);
+        const ftype sv = odd ? cr : sr;
+        const ftype cv = odd ? sr : cr;
+        s = (q >= 2) ? -sv : sv;
+        c = (q == 1 || q == 2) ? -cv : cv;
+    }
+
+    template <>
+    inline void fast_sincos<13>(const ftype x, ftype& s, ftype& c) {
+        vdt::fast_sincos(x, s, c);
+    }
+
+    template <int Degree = SIN_KERNEL_DEGREE>
+    static inline ftype fast_sin(const ftype x) {
+        ftype s, c;
+        fast_sincos<Degree>(x, s, c);
+        return s;
+    }
+
+    // The cosine from its own quadrant, rather than sin(x + pi/2) which
+    // rounds the argument
+    template <int Degree = SIN_KERNEL_DEGREE>
+    static inline ftype fast_cos(const ftype x) {
+        ftype s, c;
+        fast_sincos<Degree>(x, s, c);
+        return c;
+    }
+}
+
+#endif /* INCLUDE_BLOND_SIN_KERNELS_H_ */
@@ -47,13 +47,17 @@ class API RingAndRfSection {
                      const ftype* __restrict omega_RF,
                      const ftype* __restrict phi_RF, const int n_macroparticles,
                      const ftype acc_kick, const int_vector_t& filter);
-    // Regular kick
+    // Regular kick. For the RF system phase_rf, phase_sums also receives
+    // the sums of the sine and cosine of the RF phase of the particles,
+    // weighted by exp(phase_alpha dt), see PhaseLoop::particle_phase. A
+    // non-zero phase_alpha adds an exp per particle to the kick
     inline void kick(const uint index);
     inline void kick(const ftype* __restrict beam_dt, ftype* __restrict beam_dE,
                      const int n_rf, const ftype* __restrict voltage,
                      const ftype* __restrict omega_RF,
                      const ftype* __restrict phi_RF, const int n_macroparticles,
-                     const ftype acc_kick);
+                     const ftype acc_kick, const int phase_rf = -1,
+                     const ftype phase_alpha = 0, ftype* phase_sums = NULL);
 
     // Periodicity drift
     void drift(const int_vector_t& filter, const uint index);
@@ -64,7 +68,9 @@ class API RingAndRfSection {
                       const ftype eta_one, const ftype eta_two,
                       const ftype beta, const ftype energy,
                       const int n_macroparticles, const int_vector_t& filter);
-    // Regular drift
+    // Regular drift. With radial_sums, it also receives the sum of the
+    // energy and the number of the particles drifted into (frame_left,
+    // frame_right), see PhaseLoop::drift_radial
     inline void drift(const uint index);
     inline void drift(ftype* __restrict beam_dt,
                       const ftype* __restrict beam_dE, const solver_type solver,
@@ -72,7 +78,8 @@ class API RingAndRfSection {
                       const uint alpha_order, const ftype eta_zero,
                       const ftype eta_one, const ftype eta_two,
                       const ftype beta, const ftype energy,
-                      const int n_macroparticles);
+                      const int n_macroparticles, const ftype frame_left = 0,
+                      const ftype frame_right = 0, ftype* radial_sums = NULL);
 
     void track();
 
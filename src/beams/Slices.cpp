@@ -35,7 +35,7 @@ Slices::Slices(uint _n_slices, int _n_sigma, ftype _cut_left, ftype _cut_right,
         track();
 }
 
-Slices::~Slices() { fft::destroy_plans(); }
+Slices::~Slices() {}
 
 void Slices::set_cuts() {
     auto Beam = Context::Beam;
@@ -98,6 +98,7 @@ void Slices::sort_particles() {
               util::MyComparator(Beam->dt.data()));
     std::sort(Beam->dt.begin(), Beam->dt.end(),
               util::MyComparator(Beam->dt.data()));
+    Beam->dt_version++;
 }
 
 inline ftype Slices::convert_coordinates(const ftype cut,
@@ -118,6 +119,8 @@ inline ftype Slices::convert_coordinates(const ftype cut,
 
 void Slices::track() {
     slice_constant_space_histogram();
+    if (track_frame && track_cuts())
+        slice_constant_space_histogram();
     if (fit_option == fit_type::gaussian_fit)
         gaussian_fit();
 }
@@ -134,14 +137,41 @@ inline void Slices::slice_constant_space_histogram() {
      */
     auto Beam = Context::Beam;
 
-    histogram(Beam->dt.data(), n_macroparticles.data(), cut_left, cut_right,
-              n_slices, Beam->n_macroparticles);
+    if (store_bins) {
+        bin_index.resize(Beam->n_macroparticles);
+        bin_fraction.resize(Beam->n_macroparticles);
+        bins_version = Beam->dt_version;
+        bins_frame = frame_version;
+        bins_cut_left = cut_left;
+        bins_cut_right = cut_right;
+        histogram(Beam->dt.data(), n_macroparticles.data(), cut_left,
+                  cut_right, n_slices, Beam->n_macroparticles,
+                  bin_index.data(), bin_fraction.data());
+    } else {
+        histogram(Beam->dt.data(), n_macroparticles.data(), cut_left,
+                  cut_right, n_slices, Beam->n_macroparticles);
+    }
+}
+
+bool Slices::bins_valid() {
+    /*
+     *The stored bins describe the current beam only if neither dt nor the
+     frame have been modified since the last slicing.*
+     */
+    auto Beam = Context::Beam;
+
+    return store_bins && Beam->dt_version == bins_version &&
+           frame_version == bins_frame && cut_left == bins_cut_left &&
+           cut_right == bins_cut_right &&
+           bin_index.size() == Beam->n_macroparticles;
 }
 
 inline void Slices::histogram(const ftype* __restrict input,
                               int* __restrict output, const ftype cut_left,
                               const ftype cut_right, const uint n_slices,
-                              const uint n_macroparticles) {
+                              const uint n_macroparticles,
+                              int* __restrict bins,
+                              ftype* __restrict fractions) {
 
     const ftype inv_bin_width = n_slices / (cut_right - cut_left);
 
@@ -164,13 +194,29 @@ inline void Slices::histogram(const ftype* __restrict input,
 #pragma omp single
         h = (hist_t*)calloc(threads * n_slices, sizeof(hist_t));
 
-        for (uint i = start; i < end; ++i) {
-            ftype a = input[i];
-            if ((a < cut_left) || (a > cut_right))
-                continue;
-            uint ffbin = static_cast<uint>((a - cut_left) * inv_bin_width);
-            // h[row + ffbin] = h[row + ffbin] + 1.0;
-            h[row + ffbin] = h[row + ffbin] + 1;
+        if (bins == NULL) {
+            for (uint i = start; i < end; ++i) {
+                ftype a = input[i];
+                if ((a < cut_left) || (a > cut_right))
+                    continue;
+                uint ffbin = static_cast<uint>((a - cut_left) * inv_bin_width);
+                // h[row + ffbin] = h[row + ffbin] + 1.0;
+                h[row + ffbin] = h[row + ffbin] + 1;
+            }
+        } else {
+            for (uint i = start; i < end; ++i) {
+                ftype a = input[i];
+                if ((a < cut_left) || (a > cut_right)) {
+                    bins[i] = -1;
+                    fractions[i] = 0;
+                    continue;
+                }
+                const ftype fbin = (a - cut_left) * inv_bin_width;
+                uint ffbin = static_cast<uint>(fbin);
+                bins[i] = ffbin;
+                fractions[i] = fbin - ffbin;
+                h[row + ffbin] = h[row + ffbin] + 1;
+            }
         }
 #pragma omp barrier
 
@@ -192,24 +238,41 @@ inline void Slices::histogram(const ftype* __restrict input,
     free(h);
 }
 
-void Slices::track_cuts() {
+bool Slices::track_cuts() {
     /*
      *Track the slice frame (limits and slice position) as the mean of the
-     bunch moves.
-     Requires Beam statistics!
-     Method to be refined!*
+     bunch moves. The bunch position is estimated from the centroid of the
+     last profile, smoothed over turns, and the frame is only moved by whole
+     bins so that the grid spacing never changes. Returns true if the frame
+     moved, in which case the profile has to be recomputed.*
      */
-    auto Beam = Context::Beam;
+    ftype sum = 0;
+    ftype weighted_sum = 0;
+    for (uint i = 0; i < n_slices; ++i) {
+        sum += n_macroparticles[i];
+        weighted_sum += i * n_macroparticles[i];
+    }
+    if (sum == 0)
+        return false;
+
+    const ftype offset = weighted_sum / sum + 0.5 - 0.5 * n_slices;
+    frame_offset =
+        (1 - frame_smoothing) * frame_offset + frame_smoothing * offset;
+
+    const int shift = static_cast<int>(std::round(frame_offset));
+    if (std::abs(shift) < (int)std::max(frame_tolerance, 1u))
+        return false;
 
-    ftype delta = Beam->mean_dt - 0.5 * (cut_left + cut_right);
+    const ftype delta = shift * (cut_right - cut_left) / n_slices;
     cut_left += delta;
     cut_right += delta;
-    for (uint i = 0; i < n_slices + 1; ++i) {
-        edges[i] += delta;
-    }
-    for (uint i = 0; i < n_slices; ++i) {
-        bin_centers[i] += delta;
-    }
+    mymath::linspace(edges.data(), cut_left, cut_right, n_slices + 1);
+    for (uint i = 0; i < bin_centers.size(); ++i)
+        bin_centers[i] = (edges[i + 1] + edges[i]) / 2;
+
+    frame_offset -= shift;
+    frame_version++;
+    return true;
 }
 
 inline void Slices::smooth_histogram(const ftype* __restrict input,
@@ -389,19 +452,69 @@ void Slices::beam_spectrum_generation(uint n, bool onlyRFFT) {
     fBeamSpectrumFreq = fft::rfftfreq(n, bin_centers[1] - bin_centers[0]);
 
     if (onlyRFFT == false) {
-        // TODO remove this when you have moved to vectors
-        f_vector_t v(n_macroparticles.size()); // = n_macroparticles;
-        std::copy(n_macroparticles.begin(), n_macroparticles.end(), v.begin());
-        //(n_macroparticles, n_macroparticles + n_slices);
-        // std:: cout << "n is " << n << "\n";
-        // std:: cout << "n_slices is " << n_slices << "\n";
-        fft::rfft(v, fBeamSpectrum, n, Context::n_threads);
-        // std:: cout << "size of fBeamSpectrum is " << fBeamSpectrum.size() <<
-        // "\n";
+        // The profile is cropped or zero padded to n points, the buffers
+        // keep their size between turns
+        const uint len = std::min(n, n_slices);
+        spectrum_profile.resize(n);
+        std::copy(n_macroparticles.begin(), n_macroparticles.begin() + len,
+                  spectrum_profile.begin());
+        std::fill(spectrum_profile.begin() + len, spectrum_profile.end(), 0);
+        fBeamSpectrum.resize(n / 2 + 1);
+        fft::execute_rfft(n, spectrum_profile.data(), fBeamSpectrum.data(),
+                          Context::n_threads);
     }
 }
 
-void Slices::beam_profile_derivative() {}
+f_vector_t Slices::beam_profile_derivative(derivative_type mode) {
+    // *The derivative of the profile in [1/s], as numpy.gradient,
+    // scipy.ndimage.gaussian_filter1d(sigma=1, order=1, mode='wrap') or
+    // numpy.diff interpolated back on the bin centers*
+    const int n = n_slices;
+    const ftype dist_centers = bin_centers[1] - bin_centers[0];
+    const int* __restrict profile = n_macroparticles.data();
+    f_vector_t derivative(n, 0);
+
+    if (mode == gradient_derivative) {
+        derivative[0] = (profile[1] - profile[0]) / dist_centers;
+        for (int i = 1; i < n - 1; ++i)
+            derivative[i] = (profile[i + 1] - profile[i - 1]) /
+                            (2 * dist_centers);
+        derivative[n - 1] = (profile[n - 1] - profile[n - 2]) / dist_centers;
+
+    } else if (mode == filter1d_derivative) {
+        const int radius = 4;
+        f_vector_t weights(2 * radius + 1);
+        ftype sum = 0;
+        for (int x = -radius; x <= radius; ++x) {
+            weights[x + radius] = std::exp(-0.5 * x * x);
+            sum += weights[x + radius];
+        }
+        for (int x = -radius; x <= radius; ++x)
+            weights[x + radius] *= x / sum;
+
+        for (int i = 0; i < n; ++i) {
+            ftype d = 0;
+            for (int x = -radius; x <= radius; ++x)
+                d += weights[x + radius] * profile[((i + x) % n + n) % n];
+            derivative[i] = d / dist_centers;
+        }
+
+    } else if (mode == diff_derivative) {
+        f_vector_t diff(n - 1);
+        for (int i = 0; i < n - 1; ++i)
+            diff[i] = (profile[i + 1] - profile[i]) / dist_centers;
+        derivative[0] = diff[0];
+        for (int i = 1; i < n - 1; ++i)
+            derivative[i] = (diff[i - 1] + diff[i]) / 2;
+        derivative[n - 1] = diff[n - 2];
+
+    } else {
+        dprintf("Error: Option for derivative is not recognized.\n");
+        exit(-1);
+    }
+
+    return derivative;
+}
 
 void Slices::beam_profile_filter_chebyshev() {}
 
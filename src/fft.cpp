@@ -0,0 +1,428 @@
+/*
+ * fft.cpp
+ *
+ *  Process wide registry of the plans of fft.h and the FftConvolver
+ */
+
+#include <atomic>
+#include <blond/fft.h>
+#include <blond/globals.h>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <omp.h>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+
+namespace fft {
+
+    namespace {
+        struct plan_registry_t {
+            std::mutex lock;
+            std::mutex planner;
+            std::unordered_map<uint64_t, std::unique_ptr<fft_plan_t>> plans;
+            uint flags = FFTW_FLAGS;
+            std::string wisdomFile;
+            // (target, planner flags, threads) -> tuned size
+            std::map<std::tuple<uint, uint, uint>, uint> sizes;
+            bool tuneSizes = false;
+            std::string sizeFile;
+            // Elements per thread of the complex and of the real transforms.
+            // Read by fft_threads without the lock, which find_plan holds
+            std::atomic<uint> elems[2];
+
+            plan_registry_t() {
+                elems[0] = ELEMS_PER_THREAD_FFT;
+                elems[1] = ELEMS_PER_THREAD_RFFT;
+#ifdef USE_FFTW_OMP
+                fftw_init_threads();
+#endif
+            }
+
+            void clear() {
+                for (auto& i : plans) {
+                    fftw_destroy_plan(i.second->p);
+                    fftw_free(i.second->in);
+                    fftw_free(i.second->out);
+                }
+                plans.clear();
+            }
+
+            // Runs at the end of the program, when no other thread plans
+            ~plan_registry_t() {
+                if (!wisdomFile.empty())
+                    fftw_export_wisdom_to_filename(wisdomFile.c_str());
+                clear();
+            }
+        };
+
+        plan_registry_t& registry() {
+            static plan_registry_t r;
+            return r;
+        }
+
+        // Smooth numbers of the primes in (target, bound], appended to res
+        void smooth_numbers(uint64_t value, uint target, uint64_t bound,
+                            const uint* primes, uint nPrimes,
+                            std::vector<uint>& res) {
+            if (nPrimes == 0) {
+                if (value > target)
+                    res.push_back(value);
+                return;
+            }
+            for (uint64_t v = value; v <= bound; v *= primes[0])
+                smooth_numbers(v, target, bound, primes + 1, nPrimes - 1,
+                               res);
+        }
+
+        uint type_index(fft_type_t type) {
+            return (type == RFFT || type == IRFFT) ? 1 : 0;
+        }
+
+        // Seconds per forward transform of size n, real or complex, at the
+        // given planner flags and threads
+        double time_transform(uint n, bool real, uint threads, uint flags) {
+            ftype* in = (ftype*)fftw_malloc(sizeof(ftype) * 2 * n);
+            fftw_complex* out =
+                (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
+            fftw_plan p;
+            {
+                std::lock_guard<std::mutex> planner(planner_mutex());
+#ifdef USE_FFTW_OMP
+                fftw_plan_with_nthreads(threads);
+#endif
+                if (real)
+                    p = fftw_plan_dft_r2c_1d(n, in, out, flags);
+                else
+                    p = fftw_plan_dft_1d(n, (fftw_complex*)in, out,
+                                         FFTW_FORWARD, flags);
+            }
+
+            // The input is refilled every time, as the plan may destroy it
+            double best = 1e30;
+            for (uint rep = 0; rep < 16; ++rep) {
+                std::fill(in, in + 2 * n, 1.0);
+                const auto start = std::chrono::steady_clock::now();
+                fftw_execute(p);
+                const std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+            }
+
+            {
+                std::lock_guard<std::mutex> planner(planner_mutex());
+                fftw_destroy_plan(p);
+            }
+            fftw_free(in);
+            fftw_free(out);
+            return best;
+        }
+
+        uint fastest_size(uint target, uint flags, uint threads) {
+            const uint regular = next_regular(target);
+            uint64_t bound = 2;
+            while (bound <= target)
+                bound *= 2;
+
+            // Only even sizes are added, as the induced voltages recover the
+            // size of a transform from its spectrum length as 2 * (len - 1)
+            const uint primes[] = {3, 5, 7, 11};
+            std::vector<uint> candidates;
+            smooth_numbers(2, target, bound, primes, 4, candidates);
+            std::sort(candidates.begin(), candidates.end());
+            if (candidates.size() > 8)
+                candidates.resize(8);
+            if (std::find(candidates.begin(), candidates.end(), regular) ==
+                candidates.end())
+                candidates.push_back(regular);
+
+            uint best = regular;
+            double bestTime = time_transform(regular, true, threads, flags);
+            for (const auto n : candidates) {
+                if (n == regular)
+                    continue;
+                const double t = time_transform(n, true, threads, flags);
+                if (t < bestTime) {
+                    bestTime = t;
+                    best = n;
+                }
+            }
+            return best;
+        }
+    }
+
+    std::mutex& planner_mutex() { return registry().planner; }
+
+    fft_plan_t& find_plan(uint n, fft_type_t type, uint threads) {
+        auto& r = registry();
+        threads = fft_threads(n, type, threads);
+        const uint64_t key =
+            ((uint64_t)n << 24) | ((uint64_t)threads << 2) | type;
+
+        std::lock_guard<std::mutex> guard(r.lock);
+        auto it = r.plans.find(key);
+        if (it != r.plans.end())
+            return *it->second;
+
+        std::unique_ptr<fft_plan_t> plan(new fft_plan_t);
+        plan->n = n;
+        plan->type = type;
+        const uint flag = r.flags;
+
+        if (type == FFT || type == IFFT) {
+            fftw_complex* in =
+                (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
+            fftw_complex* out =
+                (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
+            plan->p = init_fft(n, reinterpret_cast<complex_t*>(in),
+                               reinterpret_cast<complex_t*>(out),
+                               type == FFT ? FFTW_FORWARD : FFTW_BACKWARD,
+                               flag, threads);
+            plan->in = in;
+            plan->out = out;
+
+        } else if (type == RFFT) {
+            ftype* in = (ftype*)fftw_malloc(sizeof(ftype) * n);
+            fftw_complex* out =
+                (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+            plan->p = init_rfft(n, in, reinterpret_cast<complex_t*>(out), flag,
+                                threads);
+            plan->in = in;
+            plan->out = out;
+
+        } else if (type == IRFFT) {
+            ftype* out = (ftype*)fftw_malloc(sizeof(ftype) * n);
+            fftw_complex* in =
+                (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+            plan->p = init_irfft(n, reinterpret_cast<complex_t*>(in), out,
+                                 flag, threads);
+            plan->in = in;
+            plan->out = out;
+
+        } else {
+            std::cerr << "[fft::find_plan]: ERROR "
+                      << "Wrong fft type!\n";
+            exit(-1);
+        }
+
+        return *(r.plans[key] = std::move(plan));
+    }
+
+    void destroy_plans() {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        std::lock_guard<std::mutex> planner(r.planner);
+        r.clear();
+    }
+
+    void set_planner_flags(uint flags) {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.flags = flags | FFTW_DESTROY_INPUT;
+    }
+
+    uint planner_flags() {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        return r.flags;
+    }
+
+    bool set_wisdom_file(const std::string& file) {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.wisdomFile = file;
+        if (file.empty())
+            return true;
+        std::lock_guard<std::mutex> planner(r.planner);
+        return fftw_import_wisdom_from_filename(file.c_str()) != 0;
+    }
+
+    bool export_wisdom() {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        if (r.wisdomFile.empty())
+            return false;
+        std::lock_guard<std::mutex> planner(r.planner);
+        return fftw_export_wisdom_to_filename(r.wisdomFile.c_str()) != 0;
+    }
+
+    uint fft_threads(uint n, fft_type_t type, uint requested) {
+#ifdef USE_FFTW_OMP
+        if (omp_in_parallel())
+            return 1;
+        const uint elems = registry().elems[type_index(type)];
+        const uint bySize = std::max(1u, (n + elems - 1) / elems);
+        return std::max(1u, std::min({requested, bySize,
+                                      (uint)omp_get_max_threads()}));
+#else
+        (void)n;
+        (void)type;
+        (void)requested;
+        return 1;
+#endif
+    }
+
+    uint default_threads() { return std::max(1, Context::n_threads); }
+
+    void set_elems_per_thread(fft_type_t type, uint elems) {
+        registry().elems[type_index(type)] = std::max(1u, elems);
+    }
+
+    uint elems_per_thread(fft_type_t type) {
+        return registry().elems[type_index(type)];
+    }
+
+    bool measure_thread_crossovers(uint maxSize) {
+#ifdef USE_FFTW_OMP
+        if (omp_get_max_threads() < 2)
+            return false;
+        const uint flags = planner_flags();
+        for (const bool real : {false, true}) {
+            // Serial up to maxSize if two threads never win
+            uint elems = maxSize;
+            for (uint n = 1024; n <= maxSize; n *= 2)
+                if (time_transform(n, real, 2, flags) <
+                    time_transform(n, real, 1, flags)) {
+                    elems = n / 2;
+                    break;
+                }
+            set_elems_per_thread(real ? RFFT : FFT, elems);
+        }
+        return true;
+#else
+        (void)maxSize;
+        return false;
+#endif
+    }
+
+    uint next_regular(uint target) {
+        uint64_t best = UINT64_MAX;
+        for (uint64_t p5 = 1; p5 <= best; p5 *= 5)
+            for (uint64_t p35 = p5; p35 <= best; p35 *= 3) {
+                uint64_t n = p35;
+                while (n <= target)
+                    n *= 2;
+                best = std::min(best, n);
+            }
+        return best;
+    }
+
+    uint good_size(uint target) {
+        auto& r = registry();
+        // The sizes are timed with the threads of the plans of this target
+        const uint threads = fft_threads(target, RFFT, default_threads());
+        uint flags;
+        {
+            std::lock_guard<std::mutex> guard(r.lock);
+            if (!r.tuneSizes)
+                return next_regular(target);
+            flags = r.flags;
+            auto it = r.sizes.find(std::make_tuple(target, flags, threads));
+            if (it != r.sizes.end())
+                return it->second;
+        }
+
+        const uint size = fastest_size(target, flags, threads);
+
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.sizes[std::make_tuple(target, flags, threads)] = size;
+        if (!r.sizeFile.empty()) {
+            std::ofstream out(r.sizeFile, std::ios::app);
+            out << target << " " << flags << " " << threads << " " << size
+                << "\n";
+        }
+        return size;
+    }
+
+    bool set_size_tuning(bool enable, const std::string& cacheFile) {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.tuneSizes = enable;
+        r.sizeFile = cacheFile;
+        if (cacheFile.empty())
+            return true;
+        std::ifstream in(cacheFile);
+        if (!in)
+            return false;
+        // Lines of another format are skipped
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            uint target, flags, threads, size;
+            if (fields >> target >> flags >> threads >> size)
+                r.sizes[std::make_tuple(target, flags, threads)] = size;
+        }
+        return true;
+    }
+
+    FftConvolver::FftConvolver(uint size, uint threads)
+        : fSize(size), fThreads(threads) {
+        const uint spectrumSize = fSize / 2 + 1;
+        fReal = (ftype*)fftw_malloc(sizeof(ftype) * fSize);
+        fSpectrum = (complex_t*)fftw_malloc(sizeof(complex_t) * spectrumSize);
+        fKernel = (complex_t*)fftw_malloc(sizeof(complex_t) * spectrumSize);
+        // Plans the transforms now rather than on the first convolution
+        find_plan(fSize, RFFT, fThreads);
+        find_plan(fSize, IRFFT, fThreads);
+        std::fill(fKernel, fKernel + spectrumSize, complex_t(0, 0));
+    }
+
+    FftConvolver::~FftConvolver() {
+        fftw_free(fReal);
+        fftw_free(fSpectrum);
+        fftw_free(fKernel);
+    }
+
+    void FftConvolver::set_kernel(const ftype* kernel, uint len) {
+        forward(kernel, len);
+        std::copy(fSpectrum, fSpectrum + fSize / 2 + 1, fKernel);
+    }
+
+    void FftConvolver::set_kernel_spectrum(const complex_t* spectrum) {
+        std::copy(spectrum, spectrum + fSize / 2 + 1, fKernel);
+    }
+
+    void FftConvolver::inverse_product(const complex_t* a, const complex_t* b,
+                                       ftype* res, uint resLen, ftype factor) {
+        product(a, b, factor, false);
+        inverse(res, resLen);
+    }
+
+    void FftConvolver::product(const complex_t* a, const complex_t* b,
+                               ftype factor, bool conjugate) {
+        // On the real and imaginary parts, so that the loop vectorises. b may
+        // be fSpectrum itself
+        const uint n = fSize / 2 + 1;
+        const ftype scale = factor / fSize;
+        const ftype sign = conjugate ? -1 : 1;
+        const ftype* __restrict x = reinterpret_cast<const ftype*>(a);
+        const ftype* y = reinterpret_cast<const ftype*>(b);
+        ftype* out = reinterpret_cast<ftype*>(fSpectrum);
+        for (uint i = 0; i < n; ++i) {
+            const ftype re =
+                x[2 * i] * y[2 * i] - sign * x[2 * i + 1] * y[2 * i + 1];
+            const ftype im =
+                x[2 * i] * y[2 * i + 1] + sign * x[2 * i + 1] * y[2 * i];
+            out[2 * i] = scale * re;
+            out[2 * i + 1] = scale * im;
+        }
+    }
+
+    void FftConvolver::forward_execute() {
+        // The buffers come from fftw_malloc like those of the registry, so
+        // its plans apply to them. They are looked up on every call, which
+        // keeps the object valid across destroy_plans
+        fftw_execute_dft_r2c(find_plan(fSize, RFFT, fThreads).p, fReal,
+                             reinterpret_cast<fftw_complex*>(fSpectrum));
+    }
+
+    void FftConvolver::inverse(ftype* res, uint resLen) {
+        fftw_execute_dft_c2r(find_plan(fSize, IRFFT, fThreads).p,
+                             reinterpret_cast<fftw_complex*>(fSpectrum), fReal);
+        const uint len = std::min(resLen, fSize);
+        std::copy(fReal, fReal + len, res);
+        std::fill(res + len, res + resLen, 0);
+    }
+}
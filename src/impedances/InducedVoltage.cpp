@@ -1,7 +1,6 @@
 
 #include <blond/constants.h>
 #include <blond/globals.h>
-#include <blond/impedances/Ham.h>
 #include <blond/impedances/InducedVoltage.h>
 #include <blond/math_functions.h>
 #include <blond/utilities.h>
@@ -30,6 +29,74 @@ inline void InducedVoltage::linear_interp_kick(
     }
 }
 
+inline void InducedVoltage::linear_interp_kick(
+    const int* __restrict bin_index, const ftype* __restrict bin_fraction,
+    ftype* __restrict beam_dE, const ftype* __restrict voltage_array,
+    const int n_slices, const int n_macroparticles, const ftype acc_kick) {
+
+    // bin_index and bin_fraction are measured from the left edge of the
+    // frame, the voltage is sampled at the bin centers
+#pragma omp parallel for
+    for (int i = 0; i < n_macroparticles; ++i) {
+        const ftype a = bin_index[i] + bin_fraction[i] - 0.5;
+        const int ffbin = std::min(static_cast<int>(a), n_slices - 2);
+        const ftype voltageKick =
+            ((bin_index[i] < 0) || (a < 0) || (a > n_slices - 1))
+                ? 0
+                : voltage_array[ffbin] +
+                      (a - ffbin) *
+                          (voltage_array[ffbin + 1] - voltage_array[ffbin]);
+        beam_dE[i] += voltageKick + acc_kick;
+    }
+}
+
+void InducedVoltage::induced_voltage_kick(const ftype* __restrict voltage_array,
+                                          const ftype acc_kick) {
+    // Use the bins of the last slicing if the beam has not moved since
+    auto Beam = Context::Beam;
+    auto Slice = Context::Slice;
+
+    if (Slice->bins_valid())
+        linear_interp_kick(Slice->bin_index.data(), Slice->bin_fraction.data(),
+                           Beam->dE.data(), voltage_array, Slice->n_slices,
+                           Beam->n_macroparticles, acc_kick);
+    else
+        linear_interp_kick(Beam->dt.data(), Beam->dE.data(), voltage_array,
+                           Slice->bin_centers.data(), Slice->n_slices,
+                           Beam->n_macroparticles, acc_kick);
+}
+
+void InducedVoltage::follow_frame() {
+    // Reprocess lazily, only if the slicing frame moved since the last call
+    const uint version = Context::Slice->frame_version;
+    if (fFrameVersion != version) {
+        fFrameVersion = version;
+        reprocess();
+    }
+}
+
+uint InducedVoltage::slicing_changes() {
+    auto Slice = Context::Slice;
+    const uint n = Slice->n_slices;
+    const ftype spacing = Slice->bin_centers[1] - Slice->bin_centers[0];
+    const ftype offset = Slice->bin_centers[0];
+
+    // Frame moves recompute the bin centers, so the spacing is only compared
+    // up to rounding
+    uint changes = no_change;
+    if (n != fSlicingSize)
+        changes |= size_change;
+    if (std::fabs(spacing - fSlicingSpacing) > 1e-10 * std::fabs(spacing))
+        changes |= spacing_change;
+    if (offset != fSlicingOffset)
+        changes |= offset_change;
+
+    fSlicingSize = n;
+    fSlicingSpacing = spacing;
+    fSlicingOffset = offset;
+    return changes;
+}
+
 InducedVoltageTime::InducedVoltageTime(std::vector<Intensity*>& WakeSourceList,
                                        time_or_freq TimeOrFreq) {
     // Induced voltage derived from the sum of
@@ -56,17 +123,27 @@ InducedVoltageTime::InducedVoltageTime(std::vector<Intensity*>& WakeSourceList,
     sum_wakes(fTimeArray);
 
     fCut = fTimeArray.size() + Slice->n_slices - 1;
-    fShape = next_regular(fCut);
+    fShape = fft::good_size(fCut);
 
     fTimeOrFreq = TimeOrFreq;
+    fAutoDomain = (TimeOrFreq == auto_domain);
+    fFrameVersion = Slice->frame_version;
+    slicing_changes();
+
+    if (fAutoDomain)
+        fTimeOrFreq = (mymath::convolution_method(
+                           Slice->n_slices, fTotalWake.size(), true) ==
+                       mymath::direct_convolution)
+                          ? time_domain
+                          : freq_domain;
+    if (fTimeOrFreq == freq_domain)
+        wake_spectrum_generation();
 }
 
-InducedVoltageTime::~InducedVoltageTime() { fft::destroy_plans(); }
+InducedVoltageTime::~InducedVoltageTime() { delete fConvolver; }
 
 inline void InducedVoltageTime::track() {
     auto GP = Context::GP;
-    auto Beam = Context::Beam;
-    auto Slice = Context::Slice;
 
     // Tracking Method
     f_vector_t v = this->induced_voltage_generation();
@@ -74,9 +151,7 @@ inline void InducedVoltageTime::track() {
     std::transform(v.begin(), v.end(), v.begin(),
                    std::bind1st(std::multiplies<ftype>(), GP->charge));
 
-    linear_interp_kick(Beam->dt.data(), Beam->dE.data(), v.data(),
-                       Slice->bin_centers.data(), Slice->n_slices,
-                       Beam->n_macroparticles, 0.0);
+    induced_voltage_kick(v.data(), 0.0);
 }
 
 void InducedVoltageTime::sum_wakes(f_vector_t& TimeArray) {
@@ -90,12 +165,35 @@ void InducedVoltageTime::sum_wakes(f_vector_t& TimeArray) {
     }
 }
 
+void InducedVoltageTime::add_wake(const f_vector_t& time, f_vector_t& wake) {
+    for (auto& i : fWakeSourceList) {
+        i->wake_calc(time);
+        std::transform(wake.begin(), wake.end(), i->fWake.begin(),
+                       wake.begin(), std::plus<ftype>());
+    }
+}
+
+void InducedVoltageTime::wake_spectrum_generation() {
+    // *Transform the total wake once, so that every turn costs only the
+    // transform of the profile, a product and an inverse transform.*
+    if (fConvolver == NULL || fConvolver->fSize != fShape) {
+        delete fConvolver;
+        fConvolver = new fft::FftConvolver(fShape, Context::n_threads);
+    }
+    fConvolver->set_kernel(fTotalWake.data(), fTotalWake.size());
+}
+
 void InducedVoltageTime::reprocess() {
     // *Reprocess the wake contributions with respect to the new_slicing.*
     // WARNING As Slice is a global variable,
     // users will have to change this variable and call reprocess()
+    // The wake is sampled from the first bin on, so a shift of the frame
+    // changes nothing
 
     auto Slice = Context::Slice;
+    if (!(slicing_changes() & (spacing_change | size_change)))
+        return;
+
     fTimeArray.resize(Slice->n_slices);
     for (uint i = 0; i < fTimeArray.size(); ++i) {
         fTimeArray[i] = Slice->bin_centers[i] - Slice->bin_centers[0];
@@ -103,7 +201,21 @@ void InducedVoltageTime::reprocess() {
     sum_wakes(fTimeArray);
 
     fCut = fTimeArray.size() + Slice->n_slices - 1;
-    fShape = next_regular(fCut);
+    fShape = fft::good_size(fCut);
+
+    if (fAutoDomain)
+        fTimeOrFreq = (mymath::convolution_method(
+                           Slice->n_slices, fTotalWake.size(), true) ==
+                       mymath::direct_convolution)
+                          ? time_domain
+                          : freq_domain;
+    if (fTimeOrFreq == freq_domain) {
+        wake_spectrum_generation();
+    } else {
+        // The spectrum of the old wake must not be used after a switch
+        delete fConvolver;
+        fConvolver = NULL;
+    }
 }
 
 f_vector_t InducedVoltageTime::induced_voltage_generation(uint length) {
@@ -114,36 +226,19 @@ f_vector_t InducedVoltageTime::induced_voltage_generation(uint length) {
     auto Slice = Context::Slice;
     f_vector_t inducedVoltage;
 
+    follow_frame();
+
     const ftype factor =
         -GP->charge * constant::e * Beam->intensity / Beam->n_macroparticles;
 
     if (fTimeOrFreq == freq_domain) {
-        // std::vector<complex_t> fft1, fft2;
-        // f_vector_t in1 = (Slice->n_macroparticles,
-        //               Slice->n_macroparticles + Slice->n_slices);
-        f_vector_t in1(Slice->n_slices);
-        std::copy(Slice->n_macroparticles.begin(),
-                  Slice->n_macroparticles.end(), in1.begin());
-
-        f_vector_t in2 = fTotalWake;
-
-        mymath::convolution_with_ffts(in1, in2, inducedVoltage);
-
-        /*
-        fft::rfft(in, fft1, fShape, n_threads);
-
-        in = fTotalWake;
-        fft::rfft(in, fft2, fShape, n_threads);
-
-        std::transform(fft1.begin(), fft1.end(), fft2.begin(),
-                       fft1.begin(), std::multiplies<complex_t>());
-
-        fft::irfft(fft1, inducedVoltage, fShape, n_threads);
-        */
-
-        std::transform(inducedVoltage.begin(), inducedVoltage.end(),
-                       inducedVoltage.begin(),
-                       std::bind1st(std::multiplies<ftype>(), factor));
+        // Also for objects switched to freq_domain after construction
+        if (fConvolver == NULL || fConvolver->fSize != fShape)
+            wake_spectrum_generation();
+        const uint n_slices = Slice->n_slices;
+        inducedVoltage.resize(n_slices);
+        fConvolver->convolve(Slice->n_macroparticles.data(), n_slices,
+                             inducedVoltage.data(), n_slices, factor);
 
     } else if (fTimeOrFreq == time_domain) {
         f_vector_t temp(Slice->n_slices);
@@ -179,6 +274,8 @@ InducedVoltageFreq::InducedVoltageFreq(
     bool recalculationImpedance, bool saveIndividualVoltages) {
     auto Slice = Context::Slice;
 
+    fFrameVersion = Slice->frame_version;
+    slicing_changes();
     fNTurnsMem = NTurnsMem;
 
     fImpedanceSourceList = impedanceSourceList;
@@ -211,7 +308,7 @@ InducedVoltageFreq::InducedVoltageFreq(
                 exit(-1);
                 break;
             }
-            fNFFTSampling = next_regular(a);
+            fNFFTSampling = fft::good_size(a);
 
             if (fNFFTSampling < (uint)Slice->n_slices) {
                 std::cerr << "The input frequency resolution step is too big, "
@@ -223,7 +320,7 @@ InducedVoltageFreq::InducedVoltageFreq(
                           << "you might consider changing the input in order "
                              "to have\n"
                           << "a finer resolution\n";
-                fNFFTSampling = next_regular(Slice->n_slices);
+                fNFFTSampling = fft::good_size(Slice->n_slices);
             }
         }
 
@@ -232,69 +329,56 @@ InducedVoltageFreq::InducedVoltageFreq(
         // self.frequency_array = rfftfreq(self.n_fft_sampling,
         // self.slices.bin_centers[1] - self.slices.bin_centers[0])
         fFreqArray = fft::rfftfreq(fNFFTSampling, timeResolution);
-        sum_impedances(fFreqArray);
-
         fSaveIndividualVoltages = saveIndividualVoltages;
-        if (fSaveIndividualVoltages) {
-            // Do I really need to store the length??
-            uint length = fImpedanceSourceList.size();
-            fMatrixSaveIndividualImpedances =
-                complex_vector_t(length * fFreqArray.size(), 0);
-            fMatrixSaveIndividualVoltages =
-                f_vector_t(length * Slice->n_slices, 0);
-            for (uint i = 0; i < length; ++i) {
-                const uint row_width =
-                    fImpedanceSourceList[i]->fImpedance.size();
-                for (uint j = 0; j < row_width; ++j) {
-                    fMatrixSaveIndividualImpedances[i * row_width + j] =
-                        fImpedanceSourceList[i]->fImpedance[j];
-                }
-            }
-        }
+        sum_impedances(fFreqArray);
 
     } else {
-        fNTurnsMem = NTurnsMem;
-        fLenArrayMem = (fNTurnsMem + 1) * Slice->n_slices;
-        fLenArrayMemExt = (fNTurnsMem + 2) * Slice->n_slices;
-        fNPointsFFT = next_regular(fLenArrayMemExt);
-        fFreqArrayMem = fft::rfftfreq(fNPointsFFT, timeResolution);
-        fTotalImpedanceMem =
-            complex_vector_t(fFreqArrayMem.size(), complex_t(0, 0));
-
-        fTimeArrayMem.reserve((fNTurnsMem + 1) * Slice->n_slices);
-        const ftype factor = Slice->edges.back() - Slice->edges.front();
-
-        for (uint i = 0; i < fNTurnsMem + 1; ++i) {
-            for (uint j = 0; j < (uint)Slice->n_slices; ++j) {
-                fTimeArrayMem.push_back(Slice->bin_centers[j] + factor * i);
-            }
-        }
+        fSaveIndividualVoltages = false;
+        sum_impedances_memory();
+    }
+}
 
-        for (const auto& impObj : fImpedanceSourceList) {
-            impObj->imped_calc(fFreqArrayMem);
-            std::transform(impObj->fImpedance.begin(), impObj->fImpedance.end(),
-                           fTotalImpedanceMem.begin(),
-                           fTotalImpedanceMem.begin(), std::plus<complex_t>());
-        }
+InducedVoltageFreq::~InducedVoltageFreq() {
+    if (fPlanSize > 0) {
+        fft::destroy_fft(fIndividualPlan);
+        fftw_free(fIndividualSpectra);
+        fftw_free(fIndividualVoltages);
     }
+    delete fConvolver;
 }
 
-InducedVoltageFreq::~InducedVoltageFreq() { fft::destroy_plans(); }
+void InducedVoltageFreq::individual_plan_generation() {
+    // *One plan transforms the spectra of all the sources at once, with the
+    // output size of fft::irfft*
+    const uint n = fImpedanceSourceList.size();
+    const uint size = 2 * (fNFFTSampling / 2);
+    if (fPlanSize == size)
+        return;
+
+    if (fPlanSize > 0) {
+        fft::destroy_fft(fIndividualPlan);
+        fftw_free(fIndividualSpectra);
+        fftw_free(fIndividualVoltages);
+    }
+    fPlanSize = size;
+    fIndividualSpectra =
+        (complex_t*)fftw_malloc(sizeof(complex_t) * n * (size / 2 + 1));
+    fIndividualVoltages = (ftype*)fftw_malloc(sizeof(ftype) * n * size);
+    fIndividualPlan =
+        fft::init_many_irfft(size, n, fIndividualSpectra, fIndividualVoltages,
+                             fft::planner_flags(), Context::n_threads);
+}
 
 void InducedVoltageFreq::track() {
     // Tracking Method
     auto GP = Context::GP;
-    auto Beam = Context::Beam;
-    auto Slice = Context::Slice;
 
     induced_voltage_generation();
     auto v = fInducedVoltage;
     std::transform(v.begin(), v.end(), v.begin(),
                    std::bind1st(std::multiplies<ftype>(), GP->charge));
 
-    linear_interp_kick(Beam->dt.data(), Beam->dE.data(), v.data(),
-                       Slice->bin_centers.data(), Slice->n_slices,
-                       Beam->n_macroparticles, 0.0);
+    induced_voltage_kick(v.data(), 0.0);
 }
 
 void InducedVoltageFreq::sum_impedances(f_vector_t& freq_array) {
@@ -307,11 +391,173 @@ void InducedVoltageFreq::sum_impedances(f_vector_t& freq_array) {
                        i->fImpedance.begin(), fTotalImpedance.begin(),
                        std::plus<complex_t>());
     }
+
+    if (fSaveIndividualVoltages) {
+        const uint n = fImpedanceSourceList.size();
+        const uint row_width = freq_array.size();
+        fMatrixSaveIndividualImpedances.resize(n * row_width);
+        for (uint i = 0; i < n; ++i) {
+            std::copy(fImpedanceSourceList[i]->fImpedance.begin(),
+                      fImpedanceSourceList[i]->fImpedance.end(),
+                      fMatrixSaveIndividualImpedances.begin() + i * row_width);
+        }
+        fMatrixSaveIndividualVoltages =
+            f_vector_t(n * Context::Slice->n_slices, 0);
+        individual_plan_generation();
+    }
+}
+
+void InducedVoltageFreq::sum_impedances_memory() {
+    auto Slice = Context::Slice;
+    auto timeResolution = (Slice->bin_centers[1] - Slice->bin_centers[0]);
+
+    fLenArrayMem = (fNTurnsMem + 1) * Slice->n_slices;
+    fLenArrayMemExt = (fNTurnsMem + 2) * Slice->n_slices;
+    fNPointsFFT = fft::good_size(fLenArrayMemExt);
+    fFreqArrayMem = fft::rfftfreq(fNPointsFFT, timeResolution);
+    fTotalImpedanceMem =
+        complex_vector_t(fFreqArrayMem.size(), complex_t(0, 0));
+
+    time_array_memory_generation();
+
+    for (const auto& impObj : fImpedanceSourceList) {
+        impObj->imped_calc(fFreqArrayMem);
+        std::transform(impObj->fImpedance.begin(), impObj->fImpedance.end(),
+                       fTotalImpedanceMem.begin(), fTotalImpedanceMem.begin(),
+                       std::plus<complex_t>());
+    }
+}
+
+void InducedVoltageFreq::time_array_memory_generation() {
+    // The only part of the memory sampling that follows the frame position
+    auto Slice = Context::Slice;
+    fTimeArrayMem.clear();
+    fTimeArrayMem.reserve(fLenArrayMem);
+    const ftype factor = Slice->edges.back() - Slice->edges.front();
+
+    for (uint i = 0; i < fNTurnsMem + 1; ++i) {
+        for (uint j = 0; j < (uint)Slice->n_slices; ++j) {
+            fTimeArrayMem.push_back(Slice->bin_centers[j] + factor * i);
+        }
+    }
+}
+
+uint InducedVoltageFreq::merged_sampling() {
+    // Objects with their own state per turn are kept apart
+    if (fNTurnsMem > 0 || fSaveIndividualVoltages || fRecalculationImpedance)
+        return 0;
+    return fNFFTSampling;
+}
+
+void InducedVoltageFreq::add_impedance(complex_vector_t& impedance) {
+    std::transform(impedance.begin(), impedance.end(),
+                   fTotalImpedance.begin(), impedance.begin(),
+                   std::plus<complex_t>());
+}
+
+// Resamples rows of an impedance on the uniform frequencies k*step from
+// k*old_step, keeping the last value beyond the end
+static void resample_impedance(const complex_t* __restrict in,
+                               complex_t* __restrict out, const uint n,
+                               const uint rows, const ftype ratio) {
+    for (uint r = 0; r < rows; ++r) {
+        const complex_t* row = in + r * n;
+        for (uint k = 0; k < n; ++k) {
+            const ftype x = k * ratio;
+            const uint pos = static_cast<uint>(x);
+            out[r * n + k] = (pos + 1 >= n)
+                                 ? row[n - 1]
+                                 : row[pos] + (x - pos) *
+                                                  (row[pos + 1] - row[pos]);
+        }
+    }
+}
+
+void InducedVoltageFreq::impedance_recalculation() {
+    // *Decides whether the impedance of this turn is recalculated or
+    // interpolated from the last recalculation.*
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Slice = Context::Slice;
+
+    const int turn = RfP->counter;
+    const ftype spacing = Slice->bin_centers[1] - Slice->bin_centers[0];
+    const ftype fRev = GP->f_rev[turn];
+
+    bool update = fRecalcTurn < 0 || (fRecalcPeriod > 0 &&
+                                      turn - fRecalcTurn >= (int)fRecalcPeriod);
+    if (fRecalcTolerance > 0)
+        update |= std::fabs(spacing / fRecalcSpacing - 1) > fRecalcTolerance ||
+                  std::fabs(fRev / fRecalcFRev - 1) > fRecalcTolerance;
+
+    if (update) {
+        fFreqArray = fft::rfftfreq(fNFFTSampling, spacing);
+        sum_impedances(fFreqArray);
+        fRecalcTurn = turn;
+        fRecalcSpacing = spacing;
+        fRecalcFRev = fRev;
+        fRecalcImpedance = fTotalImpedance;
+        fRecalcIndividualImpedances = fMatrixSaveIndividualImpedances;
+        fAppliedSpacing = spacing;
+        return;
+    }
+
+    if (spacing == fAppliedSpacing)
+        return;
+    fAppliedSpacing = spacing;
+    fFreqArray = fft::rfftfreq(fNFFTSampling, spacing);
+
+    // Back to the recalculated spacing after resampled turns
+    if (spacing == fRecalcSpacing) {
+        fTotalImpedance = fRecalcImpedance;
+        fMatrixSaveIndividualImpedances = fRecalcIndividualImpedances;
+        return;
+    }
+
+    // The frequencies scale with 1/spacing, the impedance follows linearly
+    const uint n = fRecalcImpedance.size();
+    const ftype ratio = fRecalcSpacing / spacing;
+    resample_impedance(fRecalcImpedance.data(), fTotalImpedance.data(), n, 1,
+                       ratio);
+    if (fSaveIndividualVoltages)
+        resample_impedance(fRecalcIndividualImpedances.data(),
+                           fMatrixSaveIndividualImpedances.data(), n,
+                           fImpedanceSourceList.size(), ratio);
+}
+
+bool InducedVoltageFreq::add_impedance_memory(complex_vector_t& impedance) {
+    if (fNTurnsMem == 0)
+        return false;
+
+    if (fTotalImpedanceMem.size() != impedance.size()) {
+        std::cerr << "The number of memory turns of InducedVoltageFreq does "
+                     "not match the one of TotalInducedVoltage\n";
+        exit(-1);
+    }
+    std::transform(impedance.begin(), impedance.end(),
+                   fTotalImpedanceMem.begin(), impedance.begin(),
+                   std::plus<complex_t>());
+    return true;
 }
 
 void InducedVoltageFreq::reprocess() {
     auto Slice = Context::Slice;
     auto timeResolution = (Slice->bin_centers[1] - Slice->bin_centers[0]);
+
+    // The impedances only depend on the number of slices and their spacing
+    const uint changes = slicing_changes();
+    const bool resampled = changes & (spacing_change | size_change);
+
+    if (fNTurnsMem > 0) {
+        if (resampled)
+            sum_impedances_memory();
+        else if (changes & offset_change)
+            time_array_memory_generation();
+        return;
+    }
+    if (!resampled)
+        return;
+
     if (fFreqResolutionInput == 0) {
         fNFFTSampling = Slice->n_slices;
     } else {
@@ -332,7 +578,7 @@ void InducedVoltageFreq::reprocess() {
             exit(-1);
             break;
         }
-        fNFFTSampling = next_regular(a);
+        fNFFTSampling = fft::good_size(a);
 
         if (fNFFTSampling < (uint)Slice->n_slices) {
             std::cerr
@@ -343,7 +589,7 @@ void InducedVoltageFreq::reprocess() {
                 << "FFT is corrected in order to sample the whole bunch (and\n"
                 << "you might consider changing the input in order to have\n"
                 << "a finer resolution\n";
-            fNFFTSampling = next_regular(Slice->n_slices);
+            fNFFTSampling = fft::good_size(Slice->n_slices);
         }
     }
 
@@ -354,6 +600,7 @@ void InducedVoltageFreq::reprocess() {
 
     fTotalImpedance.clear();
     sum_impedances(fFreqArray);
+    fRecalcTurn = -1;
 }
 
 f_vector_t InducedVoltageFreq::induced_voltage_generation(uint length) {
@@ -363,8 +610,10 @@ f_vector_t InducedVoltageFreq::induced_voltage_generation(uint length) {
     auto Beam = Context::Beam;
     auto Slice = Context::Slice;
 
+    follow_frame();
+
     if (fRecalculationImpedance)
-        sum_impedances(fFreqArray);
+        impedance_recalculation();
 
     Slice->beam_spectrum_generation(fNFFTSampling);
     // std::cout << "fNFFTSampling : " << fNFFTSampling << "\n";
@@ -374,60 +623,69 @@ f_vector_t InducedVoltageFreq::induced_voltage_generation(uint length) {
                         (Slice->fBeamSpectrum.size() - 1);
 
     if (fSaveIndividualVoltages) {
-
+        const uint n_slices = Slice->n_slices;
+        const uint n_freq = Slice->fBeamSpectrum.size();
+        const ftype* __restrict beam =
+            reinterpret_cast<const ftype*>(Slice->fBeamSpectrum.data());
+        const ftype* __restrict imp = reinterpret_cast<const ftype*>(
+            fMatrixSaveIndividualImpedances.data());
+        ftype* __restrict spectra =
+            reinterpret_cast<ftype*>(fIndividualSpectra);
+        const ftype scale = factor / fPlanSize;
+
+        // Products of every source impedance with the beam spectrum, the
+        // normalisation of the inverse FFT folded in
+#pragma omp parallel for
         for (uint i = 0; i < n; ++i) {
-            f_vector_t res;
-            complex_vector_t in(Slice->fBeamSpectrum.size());
-
-            for (uint j = 0; j < in.size(); ++j) {
-                in[j] = fMatrixSaveIndividualImpedances[j * n + i] *
-                        Slice->fBeamSpectrum[j];
-            }
-
-            fft::irfft(in, res, 0, Context::n_threads);
-
-            assert(res.size() >= Slice->n_slices);
-
-            res.resize(Slice->n_slices);
-
-            std::transform(res.begin(), res.end(), res.begin(),
-                           std::bind1st(std::multiplies<ftype>(), factor));
-
-            for (uint j = 0; j < (uint)Slice->n_slices; ++j) {
-                fMatrixSaveIndividualVoltages[j * n + i] = res[j];
+            const ftype* __restrict z = imp + 2 * i * n_freq;
+            ftype* __restrict out = spectra + 2 * i * n_freq;
+            for (uint j = 0; j < n_freq; ++j) {
+                const ftype re = z[2 * j] * beam[2 * j] -
+                                 z[2 * j + 1] * beam[2 * j + 1];
+                const ftype im = z[2 * j] * beam[2 * j + 1] +
+                                 z[2 * j + 1] * beam[2 * j];
+                out[2 * j] = scale * re;
+                out[2 * j + 1] = scale * im;
             }
         }
 
-        fInducedVoltage.clear();
-        fInducedVoltage.resize(Slice->fBeamSpectrum.size());
-        for (uint i = 0; i < Slice->fBeamSpectrum.size(); ++i) {
-            ftype sum = 0.0;
-            for (uint j = 0; j < n; ++j) {
-                sum += fMatrixSaveIndividualVoltages[i * n + j];
-            }
-            fInducedVoltage[i] = sum;
+        fft::run_fft(fIndividualPlan);
+
+        for (uint i = 0; i < n; ++i)
+            std::copy(fIndividualVoltages + i * fPlanSize,
+                      fIndividualVoltages + i * fPlanSize + n_slices,
+                      fMatrixSaveIndividualVoltages.begin() + i * n_slices);
+
+        // The total is the sum of the rows
+        fInducedVoltage.assign(fMatrixSaveIndividualVoltages.begin(),
+                               fMatrixSaveIndividualVoltages.begin() +
+                                   n_slices);
+        for (uint i = 1; i < n; ++i) {
+            const ftype* __restrict row =
+                fMatrixSaveIndividualVoltages.data() + i * n_slices;
+            for (uint j = 0; j < n_slices; ++j)
+                fInducedVoltage[j] += row[j];
         }
 
-        return f_vector_t();
+        auto res = fInducedVoltage;
+        if (length > 0)
+            res.resize(length, 0);
+        return res;
 
     } else {
-        f_vector_t res;
-        complex_vector_t in(Slice->fBeamSpectrum.size());
-        for (uint j = 0; j < in.size(); ++j) {
-            in[j] = fTotalImpedance[j] * Slice->fBeamSpectrum[j];
+        // Inverse FFT of the output size of fft::irfft, the scaling is
+        // fused with the product of the spectra
+        const uint n_fft = 2 * (Slice->fBeamSpectrum.size() - 1);
+        assert(n_fft >= Slice->n_slices);
+        if (fConvolver == NULL || fConvolver->fSize != n_fft) {
+            delete fConvolver;
+            fConvolver = new fft::FftConvolver(n_fft, Context::n_threads);
         }
-
-        fft::irfft(in, res, 0, Context::n_threads);
-        // std::cout << "res size : " << res.size() << std::endl;
-        // std::cout << "n_slices : " << Slice->n_slices << std::endl;
-        assert(res.size() >= Slice->n_slices);
-
-        res.resize((uint)Slice->n_slices);
-
-        std::transform(res.begin(), res.end(), res.begin(),
-                       std::bind1st(std::multiplies<ftype>(), factor));
-
-        fInducedVoltage = res;
+        fInducedVoltage.resize(Slice->n_slices);
+        fConvolver->inverse_product(
+            fTotalImpedance.data(), Slice->fBeamSpectrum.data(),
+            fInducedVoltage.data(), Slice->n_slices, factor);
+        f_vector_t res = fInducedVoltage;
 
         if (length > 0) {
             if (length > res.size())
@@ -440,40 +698,592 @@ f_vector_t InducedVoltageFreq::induced_voltage_generation(uint length) {
     }
 }
 
+InducedVoltageResonator::InducedVoltageResonator(Resonators* resonators,
+                                                 bool multiTurnMemory) {
+    fResonators = resonators;
+    fMultiTurnMemory = multiTurnMemory;
+    fFrameVersion = Context::Slice->frame_version;
+
+    const uint n = fResonators->fNResonators;
+    fMemoryState = complex_vector_t(n, complex_t(0, 0));
+    fStartState = fMemoryState;
+    fCoefficient.resize(n);
+    fWakeZero.resize(n);
+    fExponent.resize(n);
+    for (uint i = 0; i < n; ++i) {
+        const ftype alpha = fResonators->fOmegaR[i] / (2 * fResonators->fQ[i]);
+        const ftype omega_bar = std::sqrt(fResonators->fOmegaR[i] *
+                                              fResonators->fOmegaR[i] -
+                                          alpha * alpha);
+        fExponent[i] = complex_t(-alpha, omega_bar);
+        fCoefficient[i] =
+            2 * fResonators->fRS[i] * alpha * complex_t(1, alpha / omega_bar);
+        fWakeZero[i] = fResonators->fRS[i] * alpha;
+    }
+
+    reprocess();
+}
+
+InducedVoltageResonator::~InducedVoltageResonator() {}
+
+void InducedVoltageResonator::reprocess() {
+    auto Slice = Context::Slice;
+    const ftype timeResolution = Slice->bin_centers[1] - Slice->bin_centers[0];
+    if (!(slicing_changes() & spacing_change))
+        return;
+
+    fStep.resize(fExponent.size());
+    for (uint i = 0; i < fExponent.size(); ++i)
+        fStep[i] = std::exp(fExponent[i] * timeResolution);
+}
+
+void InducedVoltageResonator::add_wake(const f_vector_t& time,
+                                       f_vector_t& wake) {
+    fResonators->wake_calc(time);
+    std::transform(wake.begin(), wake.end(), fResonators->fWake.begin(),
+                   wake.begin(), std::plus<ftype>());
+}
+
+void InducedVoltageResonator::track() {
+    // Tracking Method
+    auto GP = Context::GP;
+
+    induced_voltage_generation();
+    auto v = fInducedVoltage;
+    std::transform(v.begin(), v.end(), v.begin(),
+                   std::bind1st(std::multiplies<ftype>(), GP->charge));
+
+    induced_voltage_kick(v.data(), 0.0);
+}
+
+f_vector_t InducedVoltageResonator::induced_voltage_generation(uint length) {
+    // *The state S of a resonator at bin i is sum_j<i p_j z^(i-j), with z
+    // the step over one bin, so S_i = z * (S_i-1 + p_i-1) and the voltage
+    // is Re(C * S_i) + W(0) * p_i. The whole turn costs
+    // O(n_slices * n_resonators), without FFT or padding.*
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+    auto Slice = Context::Slice;
+
+    follow_frame();
+
+    const int n_slices = Slice->n_slices;
+    const int n_resonators = fStep.size();
+    const int* __restrict profile = Slice->n_macroparticles.data();
+    const ftype factor =
+        -GP->charge * constant::e * Beam->intensity / Beam->n_macroparticles;
+
+    // Memory of the previous turns, advanced only once per turn
+    if (fMultiTurnMemory && (int)RfP->counter != fMemoryTurn) {
+        fStartState = fMemoryState;
+        fMemoryTurn = RfP->counter;
+    }
+    const ftype frameLength =
+        n_slices * (Slice->bin_centers[1] - Slice->bin_centers[0]);
+    const ftype gap = fMultiTurnMemory ? GP->t_rev[RfP->counter] - frameLength
+                                       : 0;
+
+    fInducedVoltage.assign(n_slices, 0);
+
+#pragma omp parallel
+    {
+        f_vector_t voltage(n_slices, 0);
+
+#pragma omp for
+        for (int r = 0; r < n_resonators; ++r) {
+            const complex_t z = fStep[r];
+            const complex_t c = fCoefficient[r];
+            const ftype w0 = fWakeZero[r];
+            complex_t state = fMultiTurnMemory ? fStartState[r] : 0;
+            for (int i = 0; i < n_slices; ++i) {
+                voltage[i] += (c * state).real() + w0 * profile[i];
+                state = z * (state + (ftype)profile[i]);
+            }
+            if (fMultiTurnMemory)
+                fMemoryState[r] = state * std::exp(fExponent[r] * gap);
+        }
+
+#pragma omp critical
+        {
+            for (int i = 0; i < n_slices; ++i)
+                fInducedVoltage[i] += factor * voltage[i];
+        }
+    }
+
+    auto res = fInducedVoltage;
+    if (length > 0)
+        res.resize(length, 0);
+    return res;
+}
+
+InductiveImpedance::InductiveImpedance(const f_vector_t& ZOverN,
+                                       derivative_type derivMode) {
+    fZOverN = ZOverN;
+    fDerivMode = derivMode;
+    fFrameVersion = Context::Slice->frame_version;
+}
+
+void InductiveImpedance::track() {
+    // Tracking Method
+    auto GP = Context::GP;
+
+    induced_voltage_generation();
+    auto v = fInducedVoltage;
+    std::transform(v.begin(), v.end(), v.begin(),
+                   std::bind1st(std::multiplies<ftype>(), GP->charge));
+
+    induced_voltage_kick(v.data(), 0.0);
+}
+
+f_vector_t InductiveImpedance::induced_voltage_generation(uint length) {
+    // *The induced voltage of a constant Z/n is proportional to the
+    // derivative of the line density, so no FFT is needed.*
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+    auto Slice = Context::Slice;
+
+    const uint index = std::min((uint)fZOverN.size() - 1, RfP->counter);
+    const ftype factor = -GP->charge * constant::e / (2 * constant::pi) *
+                         Beam->ratio * fZOverN[index] *
+                         GP->t_rev[RfP->counter] /
+                         (Slice->bin_centers[1] - Slice->bin_centers[0]);
+
+    fInducedVoltage = Slice->beam_profile_derivative(fDerivMode);
+    std::transform(fInducedVoltage.begin(), fInducedVoltage.end(),
+                   fInducedVoltage.begin(),
+                   std::bind1st(std::multiplies<ftype>(), factor));
+
+    auto res = fInducedVoltage;
+    if (length > 0)
+        res.resize(length, 0);
+    return res;
+}
+
 TotalInducedVoltage::TotalInducedVoltage(
     std::vector<InducedVoltage*>& InducedVoltageList, uint NTurnsMemory,
     f_vector_t RevTimeArray) {
     fInducedVoltageList = InducedVoltageList;
     fNTurnsMemory = NTurnsMemory;
+    fRevTimeArray = RevTimeArray;
     fInducedVoltage = f_vector_t();
     fTimeArray = Context::Slice->bin_centers;
+    fFrameVersion = Context::Slice->frame_version;
+    slicing_changes();
+
+    if (fNTurnsMemory > 0) {
+        fLenArrayMemory = (fNTurnsMemory + 1) * Context::Slice->n_slices;
+        fVoltageMemory = f_vector_t(fLenArrayMemory, 0);
+        impedance_memory_generation();
+    }
+    merge_impedances();
+}
+
+TotalInducedVoltage::~TotalInducedVoltage() {
+    ghost_clear();
+    if (fPlanSize > 0) {
+        fft::destroy_fft(fMemoryPlan);
+        fft::destroy_fft(fMemoryInversePlan);
+        fft::destroy_fft(fProfilePlan);
+        fft::destroy_fft(fProfileInversePlan);
+        fftw_free(fMemoryPadded);
+        fftw_free(fMemorySpectrum);
+        fftw_free(fProfileSpectrum);
+    }
 }
 
-TotalInducedVoltage::~TotalInducedVoltage() { fft::destroy_plans(); }
+void TotalInducedVoltage::impedance_memory_generation() {
+    // *Same sampling as InducedVoltageFreq::sum_impedances_memory, so that
+    // the impedances of the objects with memory can be summed directly.*
+    auto Slice = Context::Slice;
+    const ftype timeResolution = Slice->bin_centers[1] - Slice->bin_centers[0];
+
+    fLenArrayMemory = (fNTurnsMemory + 1) * Slice->n_slices;
+    fNPointsFFT = fft::good_size((fNTurnsMemory + 2) * Slice->n_slices);
+    fFreqArrayMemory = fft::rfftfreq(fNPointsFFT, timeResolution);
+    fTotalImpedanceMemory =
+        complex_vector_t(fFreqArrayMemory.size(), complex_t(0, 0));
+
+    fShortRangeList.clear();
+    for (auto& v : fInducedVoltageList)
+        if (!v->add_impedance_memory(fTotalImpedanceMemory))
+            fShortRangeList.push_back(v);
+
+    if (fPlanSize != fNPointsFFT) {
+        if (fPlanSize > 0) {
+            fft::destroy_fft(fMemoryPlan);
+            fft::destroy_fft(fMemoryInversePlan);
+            fft::destroy_fft(fProfilePlan);
+            fft::destroy_fft(fProfileInversePlan);
+            fftw_free(fMemoryPadded);
+            fftw_free(fMemorySpectrum);
+            fftw_free(fProfileSpectrum);
+        }
+        fPlanSize = fNPointsFFT;
+        const uint spectrumSize = fNPointsFFT / 2 + 1;
+        fMemoryPadded = (ftype*)fftw_malloc(sizeof(ftype) * fNPointsFFT);
+        fMemorySpectrum =
+            (complex_t*)fftw_malloc(sizeof(complex_t) * spectrumSize);
+        fProfileSpectrum =
+            (complex_t*)fftw_malloc(sizeof(complex_t) * spectrumSize);
+        fMemoryPlan =
+            fft::init_rfft(fNPointsFFT, fMemoryPadded, fMemorySpectrum,
+                           fft::planner_flags(), Context::n_threads);
+        fMemoryInversePlan =
+            fft::init_irfft(fNPointsFFT, fMemorySpectrum, fMemoryPadded,
+                            fft::planner_flags(), Context::n_threads);
+        fProfilePlan =
+            fft::init_rfft(fNPointsFFT, fMemoryPadded, fProfileSpectrum,
+                           fft::planner_flags(), Context::n_threads);
+        fProfileInversePlan =
+            fft::init_irfft(fNPointsFFT, fProfileSpectrum, fMemoryPadded,
+                            fft::planner_flags(), Context::n_threads);
+    }
+
+    // A change of the slicing makes the stored voltage meaningless
+    if (fVoltageMemory.size() != fLenArrayMemory)
+        fVoltageMemory = f_vector_t(fLenArrayMemory, 0);
+}
+
+void TotalInducedVoltage::merge_impedances() {
+    // *The induced voltage is linear in the impedance, so the objects that
+    // multiply the same beam spectrum can share one inverse FFT.*
+    fMergedSampling.clear();
+    fMergedImpedance.clear();
+    fUnmergedList.clear();
+
+    fInductiveImpedanceOn = false;
+    for (auto& v : fInducedVoltageList)
+        fInductiveImpedanceOn |= v->inductive();
+
+    std::vector<std::vector<InducedVoltage*>> groups;
+    for (auto& v : fInducedVoltageList) {
+        const uint n = v->merged_sampling();
+        if (n == 0) {
+            fUnmergedList.push_back(v);
+            continue;
+        }
+        auto it = std::find(fMergedSampling.begin(), fMergedSampling.end(), n);
+        if (it == fMergedSampling.end()) {
+            fMergedSampling.push_back(n);
+            groups.push_back(std::vector<InducedVoltage*>({v}));
+        } else {
+            groups[it - fMergedSampling.begin()].push_back(v);
+        }
+    }
+
+    // A single object gains nothing and keeps its own fInducedVoltage
+    uint j = 0;
+    for (uint i = 0; i < groups.size(); ++i) {
+        if (groups[i].size() == 1) {
+            fUnmergedList.push_back(groups[i][0]);
+            continue;
+        }
+        fMergedSampling[j] = fMergedSampling[i];
+        fMergedImpedance.push_back(
+            complex_vector_t(fMergedSampling[j] / 2 + 1, complex_t(0, 0)));
+        for (auto& v : groups[i])
+            v->add_impedance(fMergedImpedance[j]);
+        j++;
+    }
+    fMergedSampling.resize(j);
+}
 
 void TotalInducedVoltage::track() {
     auto GP = Context::GP;
+
+    if (fNTurnsMemory > 0) {
+        track_memory();
+        return;
+    } else if (fNGhostBunches > 0) {
+        track_ghosts_particles();
+        return;
+    }
+
+    this->induced_voltage_sum();
+    auto v = this->fInducedVoltage;
+
+    std::transform(v.begin(), v.end(), v.begin(),
+                   std::bind1st(std::multiplies<ftype>(), GP->charge));
+
+    induced_voltage_kick(v.data(), 0.0);
+}
+
+void TotalInducedVoltage::track_memory() {
+    // *Tracking method with multi-turn induced voltage. The voltage of the
+    // coming turns is kept in fVoltageMemory; every turn it is shifted by
+    // one revolution period in the frequency domain and the contribution of
+    // the current profile is added, both with transforms of fNPointsFFT.*
+    auto GP = Context::GP;
     auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
     auto Slice = Context::Slice;
 
+    follow_frame();
+
+    const uint n_slices = Slice->n_slices;
+    const uint spectrumSize = fNPointsFFT / 2 + 1;
+    const ftype timeResolution = Slice->bin_centers[1] - Slice->bin_centers[0];
+    // Beyond the given revolution times, those of the GeneralParameters
+    const ftype timeDifference = fCounterTurn < fRevTimeArray.size()
+                                     ? fRevTimeArray[fCounterTurn]
+                                     : GP->t_rev[RfP->counter];
+    const ftype factor = -GP->charge * constant::e * Beam->ratio /
+                         (fNPointsFFT * timeResolution);
+
+    std::copy(fVoltageMemory.begin(), fVoltageMemory.end(), fMemoryPadded);
+    std::fill(fMemoryPadded + fLenArrayMemory, fMemoryPadded + fNPointsFFT,
+              0);
+    fft::run_fft(fMemoryPlan);
+
+    std::copy(Slice->n_macroparticles.begin(), Slice->n_macroparticles.end(),
+              fMemoryPadded);
+    std::fill(fMemoryPadded + n_slices, fMemoryPadded + fNPointsFFT, 0);
+    fft::run_fft(fProfilePlan);
+
+#pragma omp parallel for
+    for (uint i = 0; i < spectrumSize; ++i) {
+        fMemorySpectrum[i] *= std::polar<ftype>(
+            1.0 / fNPointsFFT,
+            2 * constant::pi * fFreqArrayMemory[i] * timeDifference);
+        fProfileSpectrum[i] *= factor * fTotalImpedanceMemory[i];
+    }
+
+    // Contribution from the previous turns, the last turn is emptied
+    fft::run_fft(fMemoryInversePlan);
+    std::copy(fMemoryPadded, fMemoryPadded + fLenArrayMemory - n_slices,
+              fVoltageMemory.begin());
+    std::fill(fVoltageMemory.end() - n_slices, fVoltageMemory.end(), 0);
+
+    // Contribution from the current turn
+    fft::run_fft(fProfileInversePlan);
+    for (uint i = 0; i < fLenArrayMemory; ++i)
+        fVoltageMemory[i] += fMemoryPadded[i];
+
+    // Contribution from the objects without memory
+    for (auto& v : fShortRangeList) {
+        auto a = v->induced_voltage_generation(fLenArrayMemory);
+        for (uint i = 0; i < a.size(); ++i)
+            fVoltageMemory[i] += a[i];
+    }
+
+    fInducedVoltage.assign(fVoltageMemory.begin(),
+                           fVoltageMemory.begin() + n_slices);
+
+    auto v = fInducedVoltage;
+    std::transform(v.begin(), v.end(), v.begin(),
+                   std::bind1st(std::multiplies<ftype>(), GP->charge));
+
+    induced_voltage_kick(v.data(), 0.0);
+
+    fCounterTurn++;
+}
+
+void TotalInducedVoltage::track_ghosts_particles() {
+    // *Tracking method with ghost bunches: the induced voltage of the
+    // simulated bunch plus the wake left by its ghosts.*
+    auto GP = Context::GP;
+
     this->induced_voltage_sum();
-    auto v = this->fInducedVoltage;
 
+    auto ghost = ghost_voltage_generation();
+    std::transform(fInducedVoltage.begin(), fInducedVoltage.end(),
+                   ghost.begin(), fInducedVoltage.begin(),
+                   std::plus<ftype>());
+
+    auto v = this->fInducedVoltage;
     std::transform(v.begin(), v.end(), v.begin(),
                    std::bind1st(std::multiplies<ftype>(), GP->charge));
 
-    linear_interp_kick(Beam->dt.data(), Beam->dE.data(), v.data(),
-                       Slice->bin_centers.data(), Slice->n_slices,
-                       Beam->n_macroparticles, 0.0);
+    induced_voltage_kick(v.data(), 0.0);
 }
 
-void TotalInducedVoltage::track_memory() {}
+void TotalInducedVoltage::set_ghost_bunches(uint NGhostBunches,
+                                            ftype GhostSpacing) {
+    if (NGhostBunches > 0 && fNTurnsMemory > 0) {
+        std::cerr << "Ghost bunches are not supported together with the "
+                     "multi-turn memory of TotalInducedVoltage\n";
+        exit(-1);
+    }
+    for (auto& v : fInducedVoltageList) {
+        if (NGhostBunches > 0 && !v->has_wake() &&
+            v->impedance_sampling() == 0) {
+            std::cerr << "Ghost bunches need induced voltages with a wake "
+                         "or a sampled impedance\n";
+            exit(-1);
+        }
+    }
+    fNGhostBunches = NGhostBunches;
+    fGhostSpacing = GhostSpacing;
+    ghost_wake_generation();
+}
+
+void TotalInducedVoltage::ghost_clear() {
+    delete fGhostConvolver;
+    fGhostConvolver = NULL;
+    for (auto& c : fGhostInverse)
+        delete c;
+    fGhostInverse.clear();
+    fGhostSampling.clear();
+    fGhostPhase.clear();
+    fGhostWake.clear();
+}
+
+void TotalInducedVoltage::ghost_wake_generation() {
+    // *The ghosts are identical to the simulated bunch, so their wake only
+    // depends on the lag between a source bin and a witness bin. For the
+    // lags m in [-(n_slices-1), n_slices-1] the wakes of all the ghosts are
+    // summed once: fGhostWake[m + n_slices - 1] = sum_k W(m*dt + k*spacing).
+    // The impedances of the InducedVoltageFreq objects are multiplied
+    // instead by the shifts sum_k exp(2 pi i f k*spacing) of the ghosts.*
+    auto Slice = Context::Slice;
+    const int n_slices = Slice->n_slices;
+    const ftype timeResolution = Slice->bin_centers[1] - Slice->bin_centers[0];
 
-void TotalInducedVoltage::track_ghosts_particles() {}
+    ghost_clear();
+    fGhostSlices = n_slices;
+    if (fNGhostBunches == 0)
+        return;
+
+    bool wake = false;
+    for (auto& v : fInducedVoltageList) {
+        wake |= v->has_wake();
+        const uint n = v->impedance_sampling();
+        if (v->has_wake() || n == 0 ||
+            std::find(fGhostSampling.begin(), fGhostSampling.end(), n) !=
+                fGhostSampling.end())
+            continue;
+        // The FFT period must hold the farthest ghost and the bunch
+        if (fNGhostBunches * fGhostSpacing + n_slices * timeResolution >
+            n * timeResolution) {
+            std::cerr << "The frequency resolution of an InducedVoltageFreq "
+                         "is too coarse for the ghost bunches\n";
+            exit(-1);
+        }
+        const auto freq = fft::rfftfreq(n, timeResolution);
+        complex_vector_t phase(freq.size(), complex_t(0, 0));
+        for (uint j = 0; j < freq.size(); ++j)
+            for (uint k = 1; k <= fNGhostBunches; ++k)
+                phase[j] += std::polar<ftype>(
+                    1, 2 * constant::pi * freq[j] * k * fGhostSpacing);
+        fGhostSampling.push_back(n);
+        fGhostPhase.push_back(phase);
+        fGhostInverse.push_back(new fft::FftConvolver(n, Context::n_threads));
+    }
+    if (!wake)
+        return;
+
+    fGhostWake.assign(2 * n_slices - 1, 0);
+    f_vector_t time(fGhostWake.size());
+    for (uint k = 1; k <= fNGhostBunches; ++k) {
+        for (int m = -(n_slices - 1); m < n_slices; ++m)
+            time[m + n_slices - 1] = m * timeResolution + k * fGhostSpacing;
+        for (auto& v : fInducedVoltageList)
+            if (v->has_wake())
+                v->add_wake(time, fGhostWake);
+    }
+
+    // The wake is the same every turn, so its spectrum is kept
+    fGhostDirect = mymath::convolution_method(n_slices, fGhostWake.size(),
+                                              true) ==
+                   mymath::direct_convolution;
+    if (!fGhostDirect) {
+        fGhostConvolver = new fft::FftConvolver(
+            fft::good_size(n_slices + fGhostWake.size() - 1),
+            Context::n_threads);
+        fGhostConvolver->set_kernel(fGhostWake.data(), fGhostWake.size());
+    }
+}
+
+const f_vector_t& TotalInducedVoltage::ghost_voltage_generation() {
+    // *Induced voltage from the ghost bunches, a convolution of the profile
+    // with fGhostWake plus the inverse FFTs of the beam spectrum times the
+    // shifted impedances.*
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto Slice = Context::Slice;
+    const uint n_slices = Slice->n_slices;
+
+    if (fGhostSlices != n_slices)
+        ghost_wake_generation();
+
+    const ftype factor =
+        -GP->charge * constant::e * Beam->intensity / Beam->n_macroparticles;
+    fGhostVoltage.assign(n_slices, 0);
+
+    if (!fGhostWake.empty()) {
+        const uint size = n_slices + fGhostWake.size() - 1;
+        fGhostBuffer.resize(size);
+        if (fGhostDirect) {
+            fGhostProfile.assign(Slice->n_macroparticles.begin(),
+                                 Slice->n_macroparticles.end());
+            mymath::convolution(fGhostProfile.data(), n_slices,
+                                fGhostWake.data(), fGhostWake.size(),
+                                fGhostBuffer.data());
+            for (uint i = 0; i < n_slices; ++i)
+                fGhostVoltage[i] = factor * fGhostBuffer[i + n_slices - 1];
+        } else {
+            fGhostConvolver->convolve(Slice->n_macroparticles.data(),
+                                      n_slices, fGhostBuffer.data(), size,
+                                      factor);
+            for (uint i = 0; i < n_slices; ++i)
+                fGhostVoltage[i] = fGhostBuffer[i + n_slices - 1];
+        }
+    }
+
+    for (uint i = 0; i < fGhostSampling.size(); ++i) {
+        const uint n = fGhostSampling[i];
+        const uint n_freq = n / 2 + 1;
+        fGhostImpedance.assign(n_freq, complex_t(0, 0));
+        for (auto& v : fInducedVoltageList)
+            if (!v->has_wake() && v->impedance_sampling() == n)
+                v->add_impedance(fGhostImpedance);
+        const auto& phase = fGhostPhase[i];
+        for (uint j = 0; j < n_freq; ++j)
+            fGhostImpedance[j] *= phase[j];
+
+        // Scaled as in InducedVoltageFreq::induced_voltage_generation
+        Slice->beam_spectrum_generation(n);
+        const ftype scale = factor * Slice->fBeamSpectrumFreq[1] * 2 *
+                            (Slice->fBeamSpectrum.size() - 1);
+        fGhostBuffer.resize(n_slices);
+        fGhostInverse[i]->inverse_product(fGhostImpedance.data(),
+                                          Slice->fBeamSpectrum.data(),
+                                          fGhostBuffer.data(), n_slices,
+                                          scale);
+        for (uint j = 0; j < n_slices; ++j)
+            fGhostVoltage[j] += fGhostBuffer[j];
+    }
+
+    return fGhostVoltage;
+}
 
 void TotalInducedVoltage::reprocess() {
-    for (auto& v : fInducedVoltageList)
+    // *Every object decides what it has to rebuild; the memory, the ghost
+    // wake and the merged impedances only follow the slice spacing and the
+    // number of slices.*
+    const uint version = Context::Slice->frame_version;
+    const uint changes = slicing_changes();
+    fTimeArray = Context::Slice->bin_centers;
+    for (auto& v : fInducedVoltageList) {
         v->reprocess();
+        v->fFrameVersion = version;
+    }
+    if (!(changes & (spacing_change | size_change)))
+        return;
+
+    if (fNTurnsMemory > 0)
+        impedance_memory_generation();
+    if (fNGhostBunches > 0)
+        ghost_wake_generation();
+    merge_impedances();
+}
+
+void TotalInducedVoltage::invalidate() {
+    fSlicingSize = 0;
+    for (auto& v : fInducedVoltageList)
+        v->invalidate();
 }
 
 f_vector_t TotalInducedVoltage::induced_voltage_sum(uint length) {
@@ -481,12 +1291,47 @@ f_vector_t TotalInducedVoltage::induced_voltage_sum(uint length) {
     f_vector_t tempIndVolt;
     f_vector_t extIndVolt;
 
-    for (auto& v : fInducedVoltageList) {
+    follow_frame();
+
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto Slice = Context::Slice;
+    for (uint i = 0; i < fMergedSampling.size(); ++i) {
+        Slice->beam_spectrum_generation(fMergedSampling[i]);
+        // The inverse FFT is not normalised, its 1/n_fft cancels the
+        // n_fft of the usual factor
+        const uint n_freq = Slice->fBeamSpectrum.size();
+        const uint n_fft = 2 * (n_freq - 1);
+        const ftype factor = -GP->charge * constant::e * Beam->ratio *
+                             Slice->fBeamSpectrumFreq[1];
+        const auto& impedance = fMergedImpedance[i];
+        fSpectrumBuffer.resize(n_freq);
+        for (uint j = 0; j < n_freq; ++j)
+            fSpectrumBuffer[j] =
+                factor * impedance[j] * Slice->fBeamSpectrum[j];
+
+        fVoltageBuffer.resize(n_fft);
+        fft::execute_irfft(n_fft, fSpectrumBuffer.data(),
+                           fVoltageBuffer.data(), Context::n_threads);
+        const ftype* res = fVoltageBuffer.data();
+        const uint n_slices = Slice->n_slices;
+
+        if (length > 0) {
+            extIndVolt.resize(std::max((uint)extIndVolt.size(), length), 0);
+            for (uint j = 0; j < std::min(n_slices, length); ++j)
+                extIndVolt[j] += res[j];
+        }
+        tempIndVolt.resize(n_slices, 0);
+        for (uint j = 0; j < n_slices; ++j)
+            tempIndVolt[j] += res[j];
+    }
+
+    for (auto& v : fUnmergedList) {
         auto a = v->induced_voltage_generation(length);
 
         if (length > 0) {
-            extIndVolt.resize(a.size(), 0);
-            std::transform(extIndVolt.begin(), extIndVolt.end(), a.begin(),
+            extIndVolt.resize(std::max(extIndVolt.size(), a.size()), 0);
+            std::transform(a.begin(), a.end(), extIndVolt.begin(),
                            extIndVolt.begin(), std::plus<ftype>());
         }
         tempIndVolt.resize(v->fInducedVoltage.size(), 0);
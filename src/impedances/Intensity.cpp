@@ -8,6 +8,80 @@
 #include <blond/constants.h>
 #include <blond/impedances/Intensity.h>
 #include <blond/math_functions.h>
+#include <blond/sincos.h>
+
+size_t Intensity::hash_vector(const f_vector_t& v, size_t seed) {
+    // FNV-1a over the bytes of the array
+    size_t hash = seed ^ 14695981039346656037ULL;
+    const unsigned char* bytes =
+        reinterpret_cast<const unsigned char*>(v.data());
+    for (size_t i = 0; i < v.size() * sizeof(ftype); ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash ^ v.size();
+}
+
+// Start and step of a uniform grid, step is 0 if the grid is not uniform
+static void uniform_grid(const f_vector_t& freq, ftype& start, ftype& step) {
+    start = freq.empty() ? 0 : freq.front();
+    step = freq.size() > 1 ? freq[1] - freq[0] : 0;
+    const ftype tolerance = 1e-12 * std::fabs(freq.empty() ? 0 : freq.back());
+    for (uint i = 2; i < freq.size(); ++i) {
+        if (std::fabs(freq[i] - (start + i * step)) > tolerance) {
+            step = 0;
+            return;
+        }
+    }
+}
+
+// Start and step of a grid from its first samples, step is 0 if the last
+// sample does not follow them. The cache assumes that the grids passed to
+// imped_calc are uniform, as the rfftfreq grids are, and does not scan them
+static void grid_key(const f_vector_t& freq, ftype& start, ftype& step) {
+    const uint n = freq.size();
+    start = n > 0 ? freq.front() : 0;
+    step = n > 1 ? freq[1] - freq[0] : 0;
+    if (n > 2 && std::fabs(freq.back() - (start + (n - 1) * step)) >
+                     1e-12 * std::fabs(freq.back()))
+        step = 0;
+}
+
+void Intensity::parameters_changed() {
+    fParametersHash = parameters_hash();
+    fImpedanceCache.clear();
+}
+
+bool Intensity::impedance_from_cache(const f_vector_t& freq) {
+    ftype start, step;
+    grid_key(freq, start, step);
+    if (step == 0)
+        return false;
+
+    for (uint i = 0; i < fImpedanceCache.size(); ++i) {
+        const auto& e = fImpedanceCache[i];
+        if (e.length == freq.size() && e.start == start && e.step == step &&
+            e.hash == fParametersHash) {
+            std::rotate(fImpedanceCache.begin(), fImpedanceCache.begin() + i,
+                        fImpedanceCache.begin() + i + 1);
+            fFreqArray = freq;
+            fImpedance = fImpedanceCache.front().impedance;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Intensity::impedance_to_cache(const f_vector_t& freq) {
+    ftype start, step;
+    grid_key(freq, start, step);
+    if (step == 0 || fImpedanceCacheSize == 0)
+        return;
+
+    ImpedanceCacheEntry e = {start, step, (uint)freq.size(), fParametersHash,
+                             fImpedance};
+    fImpedanceCache.insert(fImpedanceCache.begin(), e);
+    if (fImpedanceCache.size() > fImpedanceCacheSize)
+        fImpedanceCache.resize(fImpedanceCacheSize);
+}
 
 Resonators::Resonators(f_vector_t& RS, f_vector_t& FrequencyR, f_vector_t& Q) {
     fRS = RS;
@@ -17,52 +91,141 @@ Resonators::Resonators(f_vector_t& RS, f_vector_t& FrequencyR, f_vector_t& Q) {
     fOmegaR.reserve(fNResonators);
     for (unsigned int i = 0; i < fNResonators; ++i)
         fOmegaR.push_back(2 * constant::pi * fFrequencyR[i]);
+    parameters_changed();
 }
 
 Resonators::~Resonators() {}
 
+size_t Resonators::parameters_hash() const {
+    return hash_vector(fQ, hash_vector(fFrequencyR, hash_vector(fRS)));
+}
+
 void Resonators::wake_calc(const f_vector_t& NewTimeArray) {
     /*
     * Wake calculation method as a function of time.*
     */
+    // W(t) = (sign(t) + 1) / 2 * Re(C * exp((-alpha + i*omega_bar) * t)),
+    // C = 2 * R * alpha * (1 + i * alpha / omega_bar)
     fTimeArray = NewTimeArray;
     fWake.resize(fTimeArray.size());
     std::fill_n(fWake.begin(), fWake.size(), 0);
-    // util::dump(&fWake[0], 10, "start wake ");
-
-    for (uint i = 0; i < fNResonators; ++i) {
-        ftype alpha = fOmegaR[i] / (2 * fQ[i]);
-        ftype omega_bar = std::sqrt(fOmegaR[i] * fOmegaR[i] - alpha * alpha);
-
-        for (uint j = 0; j < fWake.size(); ++j) {
-            ftype temp = fTimeArray[j];
-            // util::dump(&temp, 1, "temp ");
-            int sign = (temp > 0) - (temp < 0);
-            fWake[j] += (sign + 1) * fRS[i] * alpha * std::exp(-alpha * temp) *
-                        (std::cos(omega_bar * temp) -
-                         alpha / omega_bar * std::sin(omega_bar * temp));
+
+    const int n = fTimeArray.size();
+    const uint n_res = fNResonators;
+    f_vector_t alpha(n_res), omega_bar(n_res), c_re(n_res), c_im(n_res);
+    for (uint i = 0; i < n_res; ++i) {
+        alpha[i] = fOmegaR[i] / (2 * fQ[i]);
+        omega_bar[i] = std::sqrt(fOmegaR[i] * fOmegaR[i] - alpha[i] * alpha[i]);
+        c_re[i] = 2 * fRS[i] * alpha[i];
+        c_im[i] = c_re[i] * alpha[i] / omega_bar[i];
+    }
+
+    ftype start, step;
+    uniform_grid(fTimeArray, start, step);
+
+    if (step <= 0) {
+        // Any grid: every sample evaluated on its own
+#pragma omp parallel for
+        for (int j = 0; j < n; ++j) {
+            const ftype t = fTimeArray[j];
+            if (t < 0)
+                continue;
+            const ftype h = (t > 0) ? 1 : 0.5;
+            ftype sum = 0;
+            for (uint i = 0; i < n_res; ++i) {
+                ftype s, c;
+                vdt::fast_sincos(omega_bar[i] * t, s, c);
+                sum += std::exp(-alpha[i] * t) * (c_re[i] * c - c_im[i] * s);
+            }
+            fWake[j] = h * sum;
         }
+        return;
     }
+
+    // Increasing uniform grid: the samples with t >= 0 are split in blocks,
+    // each started from an exact value and continued by multiplying with
+    // exp((-alpha + i*omega_bar) * step), which keeps the rounding error of
+    // the recurrence bounded by the block length
+    const int block = 64;
+    int first = std::max(0, std::min(n, (int)std::ceil(-start / step)));
+    while (first > 0 && fTimeArray[first - 1] >= 0)
+        first--;
+    while (first < n && fTimeArray[first] < 0)
+        first++;
+    const int n_blocks = (n - first + block - 1) / block;
+
+#pragma omp parallel for
+    for (int b = 0; b < n_blocks; ++b) {
+        const int lo = first + b * block;
+        const int hi = std::min(n, lo + block);
+        ftype* __restrict wake = fWake.data();
+        for (uint i = 0; i < n_res; ++i) {
+            ftype zs, zc, s, c;
+            vdt::fast_sincos(omega_bar[i] * step, zs, zc);
+            const ftype damp = std::exp(-alpha[i] * step);
+            const ftype z_re = damp * zc, z_im = damp * zs;
+
+            const ftype t0 = fTimeArray[lo];
+            vdt::fast_sincos(omega_bar[i] * t0, s, c);
+            const ftype e0 = std::exp(-alpha[i] * t0);
+            ftype re = e0 * c, im = e0 * s;
+            for (int j = lo; j < hi; ++j) {
+                wake[j] += c_re[i] * re - c_im[i] * im;
+                const ftype tmp = re * z_re - im * z_im;
+                im = re * z_im + im * z_re;
+                re = tmp;
+            }
+        }
+    }
+    // The sample exactly at t = 0 only gets half of the wake
+    for (int j = first; j < n && fTimeArray[j] <= 0; ++j)
+        fWake[j] *= 0.5;
 }
 
 void Resonators::imped_calc(const f_vector_t& NewFrequencyArray) {
     /*
     * Impedance calculation method as a function of frequency.*
     */
+    // The parameters are public, hashing them costs O(n_resonators) and
+    // catches edits made without parameters_changed
+    if (parameters_hash() != fParametersHash)
+        parameters_changed();
+    if (impedance_from_cache(NewFrequencyArray))
+        return;
 
     fFreqArray = NewFrequencyArray;
     fImpedance.resize(fFreqArray.size());
-    // fImpedance[0] = complex_t(0, 0);
-    std::fill_n(fImpedance.begin(), fImpedance.size(), complex_t(0, 0));
-    // std::cout << complex_t(1,0) / complex_t(1,1) << '\n';
-    for (uint i = 0; i < fNResonators; ++i) {
-        for (uint j = 1; j < fImpedance.size(); ++j) {
-            fImpedance[j] +=
-                complex_t(fRS[i], 0) /
-                complex_t(1, fQ[i] * (fFreqArray[j] / fFrequencyR[i] -
-                                      fFrequencyR[i] / fFreqArray[j]));
+    if (fImpedance.empty())
+        return;
+    fImpedance[0] = complex_t(0, 0);
+
+    // R / (1 + iy) = R * (1 - iy) / (1 + y^2), y = Q * (f/fr - fr/f), in
+    // real arithmetic so that the sum over the resonators vectorises
+    const uint n = fNResonators;
+    f_vector_t a(n), b(n);
+    for (uint i = 0; i < n; ++i) {
+        a[i] = fQ[i] / fFrequencyR[i];
+        b[i] = fQ[i] * fFrequencyR[i];
+    }
+    const ftype* __restrict pa = a.data();
+    const ftype* __restrict pb = b.data();
+    const ftype* __restrict rs = fRS.data();
+
+#pragma omp parallel for
+    for (uint j = 1; j < fImpedance.size(); ++j) {
+        const ftype f = fFreqArray[j];
+        const ftype inv_f = 1 / f;
+        ftype re = 0, im = 0;
+        for (uint i = 0; i < n; ++i) {
+            const ftype y = pa[i] * f - pb[i] * inv_f;
+            const ftype r = rs[i] / (1 + y * y);
+            re += r;
+            im -= r * y;
         }
+        fImpedance[j] = complex_t(re, im);
     }
+
+    impedance_to_cache(fFreqArray);
 }
 
 InputTable::InputTable(const f_vector_t& input1, const f_vector_t& input2,
@@ -90,31 +253,254 @@ InputTable::InputTable(const f_vector_t& input1, const f_vector_t& input2,
             fImZArrayLoaded.insert(fImZArrayLoaded.begin(), 0);
         }
     }
+    parameters_changed();
 }
 
 InputTable::~InputTable() {}
 
+size_t InputTable::parameters_hash() const {
+    return hash_vector(
+        fImZArrayLoaded,
+        hash_vector(fReZArrayLoaded, hash_vector(fFrequencyArrayLoaded)));
+}
+
 void InputTable::wake_calc(const f_vector_t& NewTimeArray) {
-    mymath::lin_interp(NewTimeArray, fTimeArray, fWakeArray, fWake, 0.0f, 0.0f);
+    // A table loaded as an impedance has no wake
+    if (fWakeArray.empty()) {
+        fWake.assign(NewTimeArray.size(), 0);
+        return;
+    }
+    mymath::lin_interp(NewTimeArray, fTimeArray, fWakeArray, fWake);
 }
 
 void InputTable::imped_calc(const f_vector_t& NewFrequencyArray) {
     // Impedance calculation method as a function of frequency.*
-    f_vector_t ReZ;
-    f_vector_t ImZ;
+    if (impedance_from_cache(NewFrequencyArray))
+        return;
 
-    mymath::lin_interp(NewFrequencyArray, fFrequencyArrayLoaded,
-                       fReZArrayLoaded, ReZ, 0.0f, 0.0f);
+    fFreqArray = NewFrequencyArray;
 
-    mymath::lin_interp(NewFrequencyArray, fFrequencyArrayLoaded,
-                       fImZArrayLoaded, ImZ, 0.0f, 0.0f);
+    // Real and imaginary parts interpolated in one pass, as numpy.interp
+    // with 0 outside the table
+    complex_vector_t loaded(fFrequencyArrayLoaded.size());
+    for (uint k = 0; k < loaded.size(); ++k)
+        loaded[k] = complex_t(fReZArrayLoaded[k], fImZArrayLoaded[k]);
+    mymath::lin_interp(fFreqArray, fFrequencyArrayLoaded, loaded, fImpedance);
 
-    fFreqArray = NewFrequencyArray;
+    impedance_to_cache(fFreqArray);
+}
+
+// Response of a resonator of unit shunt impedance
+static inline complex_t resonator_response(ftype f, ftype fr, ftype Q) {
+    const ftype y = Q * (f / fr - fr / f);
+    const ftype r = 1 / (1 + y * y);
+    return complex_t(r, -r * y);
+}
+
+// Reduction of the squared residual obtained by the best real multiple of
+// the resonator (fr, Q)
+static ftype fit_gain(const f_vector_t& freq, const complex_vector_t& res,
+                      ftype fr, ftype Q) {
+    ftype c = 0, g = 0;
+#pragma omp parallel for reduction(+ : c, g)
+    for (uint j = 0; j < freq.size(); ++j) {
+        const complex_t b = resonator_response(freq[j], fr, Q);
+        c += b.real() * res[j].real() + b.imag() * res[j].imag();
+        g += b.real();
+    }
+    return g > 0 ? c * c / g : 0;
+}
+
+// Pattern search on log(fr) and log(Q) for the resonator that best fits
+// the residual, returns the gain. fr stays inside the frequencies of the
+// table and Q in [0.5, 1e6], where a broadband residual would otherwise
+// drive Q to 0 or fr out of the table.
+static ftype fit_resonator(const f_vector_t& freq, const complex_vector_t& res,
+                           ftype& fr, ftype& Q, ftype step) {
+    const ftype minQ = 0.5, maxQ = 1e6;
+    ftype best = fit_gain(freq, res, fr, Q);
+    while (step > 1e-4) {
+        bool moved = false;
+        for (int d = 0; d < 4; ++d) {
+            const ftype m = std::exp(d % 2 ? -step : step);
+            const ftype trialFr =
+                d < 2 ? std::min(std::max(fr * m, freq.front()), freq.back())
+                      : fr;
+            const ftype trialQ =
+                d < 2 ? Q : std::min(std::max(Q * m, minQ), maxQ);
+            const ftype gain = fit_gain(freq, res, trialFr, trialQ);
+            if (gain > best) {
+                best = gain;
+                fr = trialFr;
+                Q = trialQ;
+                moved = true;
+            }
+        }
+        if (!moved)
+            step /= 2;
+    }
+    return best;
+}
+
+// Re <a, b>
+static ftype real_dot(const complex_vector_t& a, const complex_vector_t& b) {
+    ftype s = 0;
+#pragma omp parallel for reduction(+ : s)
+    for (uint j = 0; j < a.size(); ++j)
+        s += a[j].real() * b[j].real() + a[j].imag() * b[j].imag();
+    return s;
+}
+
+// Solves the system a x = b by Gaussian elimination, false if the system
+// is singular
+static bool solve_linear(f_vector_2d_t a, f_vector_t b, f_vector_t& x) {
+    const uint n = b.size();
+    for (uint k = 0; k < n; ++k) {
+        uint p = k;
+        for (uint i = k + 1; i < n; ++i)
+            if (std::fabs(a[i][k]) > std::fabs(a[p][k]))
+                p = i;
+        if (std::fabs(a[p][k]) <= 1e-12 * std::fabs(a[0][0]))
+            return false;
+        std::swap(a[k], a[p]);
+        std::swap(b[k], b[p]);
+        for (uint i = k + 1; i < n; ++i) {
+            const ftype m = a[i][k] / a[k][k];
+            for (uint j = k; j < n; ++j)
+                a[i][j] -= m * a[k][j];
+            b[i] -= m * b[k];
+        }
+    }
+    x.assign(n, 0);
+    for (int k = n - 1; k >= 0; --k) {
+        ftype s = b[k];
+        for (uint j = k + 1; j < n; ++j)
+            s -= a[k][j] * x[j];
+        x[k] = s / a[k][k];
+    }
+    return true;
+}
+
+Resonators* InputTable::fit_resonators(ftype tolerance, uint maxResonators) {
+    if (fFrequencyArrayLoaded.empty()) {
+        std::cerr << "Error: fit_resonators needs a table loaded as an "
+                  << "impedance\n";
+        exit(-1);
+    }
 
-    // Initializing real and imaginary part separately has been
-    // omitted
-    fImpedance.resize(ReZ.size());
-    for (uint i = 0; i < ReZ.size(); ++i) {
-        fImpedance[i] = complex_t(ReZ[i], ImZ[i]);
+    // The resonators vanish at f = 0, only positive frequencies are fitted
+    f_vector_t freq;
+    complex_vector_t z;
+    for (uint i = 0; i < fFrequencyArrayLoaded.size(); ++i) {
+        if (fFrequencyArrayLoaded[i] <= 0)
+            continue;
+        freq.push_back(fFrequencyArrayLoaded[i]);
+        z.push_back(complex_t(fReZArrayLoaded[i], fImZArrayLoaded[i]));
     }
+    const uint n = freq.size();
+    const ftype norm = real_dot(z, z);
+
+    f_vector_t RS, frequencyR, Q;
+    std::vector<complex_vector_t> columns;
+    f_vector_2d_t gram;
+    f_vector_t projection;
+    complex_vector_t res = z;
+    // Residual without one of the resonators, for their refit
+    complex_vector_t other(n);
+
+    // Response of resonator i and its products with the others and the table
+    auto set_column = [&](uint i) {
+        for (uint j = 0; j < n; ++j)
+            columns[i][j] = resonator_response(freq[j], frequencyR[i], Q[i]);
+        for (uint l = 0; l < columns.size(); ++l)
+            gram[i][l] = gram[l][i] = real_dot(columns[i], columns[l]);
+        projection[i] = real_dot(columns[i], z);
+    };
+    // Shunt impedances by least squares, and the residual
+    auto solve = [&]() {
+        if (!solve_linear(gram, projection, RS))
+            return false;
+        ftype err = 0;
+#pragma omp parallel for reduction(+ : err)
+        for (uint j = 0; j < n; ++j) {
+            complex_t fit(0, 0);
+            for (uint i = 0; i < columns.size(); ++i)
+                fit += RS[i] * columns[i][j];
+            res[j] = z[j] - fit;
+            err += std::norm(res[j]);
+        }
+        fFitError = std::sqrt(err / norm);
+        return true;
+    };
+
+    fFitError = norm > 0 ? 1 : 0;
+    while (fFitError > tolerance && RS.size() < maxResonators) {
+        // Initial guess from the highest peak of the residual, the quality
+        // factor from its full width at half maximum
+        uint p = 0;
+        for (uint j = 0; j < n; ++j)
+            if (res[j].real() > res[p].real())
+                p = j;
+        const bool real = res[p].real() > 0;
+        if (!real) {
+            for (uint j = 0; j < n; ++j)
+                if (std::abs(res[j]) > std::abs(res[p]))
+                    p = j;
+        }
+        auto height = [&](uint j) {
+            return real ? res[j].real() : std::abs(res[j]);
+        };
+        uint lo = p, hi = p;
+        while (lo > 0 && height(lo) > height(p) / 2)
+            lo--;
+        while (hi < n - 1 && height(hi) > height(p) / 2)
+            hi++;
+        ftype fr = freq[p];
+        ftype q = hi > lo ? fr / (freq[hi] - freq[lo]) : 1;
+        q = std::min(std::max(q, (ftype)0.5), (ftype)1e6);
+
+        if (fit_resonator(freq, res, fr, q, 0.1) <= 1e-12 * norm)
+            break;
+
+        const uint k = columns.size();
+        frequencyR.push_back(fr);
+        Q.push_back(q);
+        columns.push_back(complex_vector_t(n));
+        for (auto& row : gram)
+            row.push_back(0);
+        gram.push_back(f_vector_t(k + 1));
+        projection.push_back(0);
+        set_column(k);
+        if (!solve()) {
+            frequencyR.pop_back();
+            Q.pop_back();
+            columns.pop_back();
+            gram.pop_back();
+            for (auto& row : gram)
+                row.pop_back();
+            projection.pop_back();
+            solve();
+            break;
+        }
+
+        // The earlier resonators are refitted, each against the residual
+        // of all the others
+        for (uint sweep = 0; sweep < 2 && k > 0; ++sweep) {
+            for (uint i = 0; i <= k; ++i) {
+                for (uint j = 0; j < n; ++j)
+                    other[j] = res[j] + RS[i] * columns[i][j];
+                const ftype oldFr = frequencyR[i], oldQ = Q[i];
+                fit_resonator(freq, other, frequencyR[i], Q[i], 0.02);
+                set_column(i);
+                if (!solve()) {
+                    frequencyR[i] = oldFr;
+                    Q[i] = oldQ;
+                    set_column(i);
+                    solve();
+                }
+            }
+        }
+    }
+
+    return new Resonators(RS, frequencyR, Q);
 }
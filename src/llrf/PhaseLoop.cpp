@@ -26,40 +26,59 @@ void PhaseLoop::beam_phase() {
     auto RfP = Context::RfP;
     auto Slice = Context::Slice;
 
-    ftype omega_RF = RfP->omega_RF[RfP->idx][RfP->counter];
-    ftype phi_RF = RfP->phi_RF[RfP->idx][RfP->counter];
-    // Convolve with window function
-    //
-    ftype* base = new ftype[Slice->n_slices];
-    ftype* array = new ftype[Slice->n_slices];
-
-#pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const ftype a = alpha * Slice->bin_centers[i];
-        base[i] = std::exp(a) * Slice->n_macroparticles[i];
+    // Each set of particle sums is used once
+    if (particle_phase && particle_sums) {
+        particle_sums = false;
+        phi_beam = std::atan(particle_sin / particle_cos) + constant::pi;
+        return;
     }
 
-#pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const ftype a = omega_RF * Slice->bin_centers[i] + phi_RF;
-        array[i] = base[i] * std::sin(a);
+    const ftype omega_RF = RfP->omega_RF[RfP->idx][RfP->counter];
+    const ftype phi_RF = RfP->phi_RF[RfP->idx][RfP->counter];
+    const int n_slices = Slice->n_slices;
+    const ftype* bin_centers = Slice->bin_centers.data();
+
+    // The window, folded with the weights of the trapezoid rule, changes
+    // only with the slicing
+    if (window.empty() || alpha != window_alpha ||
+        window_bin_centers != Slice->bin_centers) {
+        window_alpha = alpha;
+        window_bin_centers = Slice->bin_centers;
+        window.resize(n_slices);
+        for (int i = 0; i < n_slices; ++i) {
+            const ftype left = bin_centers[std::max(i - 1, 0)];
+            const ftype right = bin_centers[std::min(i + 1, n_slices - 1)];
+            window[i] = std::exp(alpha * bin_centers[i]) * (right - left) / 2;
+        }
     }
-    ftype scoeff =
-        mymath::trapezoid(array, Slice->bin_centers.data(), Slice->n_slices);
 
-#pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const ftype a = omega_RF * Slice->bin_centers[i] + phi_RF;
-        array[i] = base[i] * std::cos(a);
+    // Convolve with window function, sine and cosine in one pass. The
+    // thread start up outweighs the loop for the usual number of slices
+    const ftype* __restrict w = window.data();
+    const int* __restrict profile = Slice->n_macroparticles.data();
+    ftype scoeff = 0, ccoeff = 0;
+#pragma omp parallel for reduction(+ : scoeff, ccoeff) if (n_slices > 10000)
+    for (int i = 0; i < n_slices; ++i) {
+        ftype s, c;
+        mymath::fast_sincos<13>(omega_RF * bin_centers[i] + phi_RF, s, c);
+        const ftype a = w[i] * profile[i];
+        scoeff += a * s;
+        ccoeff += a * c;
     }
 
-    ftype ccoeff =
-        mymath::trapezoid(array, Slice->bin_centers.data(), Slice->n_slices);
-
     phi_beam = std::atan(scoeff / ccoeff) + constant::pi;
+}
 
-    delete[] base;
-    delete[] array;
+void PhaseLoop::set_particle_sums(ftype sin_sum, ftype cos_sum) {
+    particle_sin = sin_sum;
+    particle_cos = cos_sum;
+    particle_sums = true;
+}
+
+void PhaseLoop::set_radial_sums(ftype dE_sum, uint n_inside) {
+    radial_dE_sum = dE_sum;
+    radial_n_inside = n_inside;
+    radial_sums = true;
 }
 
 void PhaseLoop::phase_difference() {
@@ -121,14 +140,40 @@ void PhaseLoop::radial_difference() {
 
     // Radial difference between beam and design orbit.*
     uint counter = RfP->counter;
-    uint n = 0;
+    int n = 0;
     ftype sum = 0;
-    // ftype array[GP->n_turns];
-    for (uint i = 0; i < GP->n_turns; ++i) {
-        if (Beam->dt[i] > Slice->bin_centers.front() &&
-            Beam->dt[i] < Slice->bin_centers.back()) {
-            sum += Beam->dE[i];
-            n++;
+    if (drift_radial && radial_sums) {
+        // Each sum of the drift is used once
+        radial_sums = false;
+        sum = radial_dE_sum;
+        n = radial_n_inside;
+    } else if (Slice->bins_valid()) {
+        // The bins of the last slicing tell which particles are inside,
+        // (left, right) is 0 < index + fraction - 0.5 < n_slices - 1
+        const int* __restrict index = Slice->bin_index.data();
+        const ftype* __restrict fraction = Slice->bin_fraction.data();
+        const ftype* __restrict dE = Beam->dE.data();
+        const ftype last = Slice->n_slices - 1;
+        const int n_macroparticles = Beam->n_macroparticles;
+#pragma omp parallel for reduction(+ : sum, n)
+        for (int i = 0; i < n_macroparticles; ++i) {
+            const ftype a = index[i] + fraction[i] - 0.5;
+            const bool inside = index[i] >= 0 && a > 0 && a < last;
+            sum += inside ? dE[i] : 0;
+            n += inside;
+        }
+    } else {
+        // Mean energy of the particles inside the frame
+        const ftype left = Slice->bin_centers.front();
+        const ftype right = Slice->bin_centers.back();
+        const ftype* __restrict dt = Beam->dt.data();
+        const ftype* __restrict dE = Beam->dE.data();
+        const int n_macroparticles = Beam->n_macroparticles;
+#pragma omp parallel for reduction(+ : sum, n)
+        for (int i = 0; i < n_macroparticles; ++i) {
+            const bool inside = dt[i] > left && dt[i] < right;
+            sum += inside ? dE[i] : 0;
+            n += inside;
         }
     }
     auto average_dE = n > 0 ? sum / n : 0.0;
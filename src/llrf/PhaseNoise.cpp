@@ -30,7 +30,7 @@ PhaseNoise::PhaseNoise(f_vector_t freqArray, f_vector_t realPartOfSpectrum,
     fDt = 0;
 }
 
-PhaseNoise::~PhaseNoise() { fft::destroy_plans(); }
+PhaseNoise::~PhaseNoise() {}
 
 void PhaseNoise::spectrum_to_phase_noise(PhaseNoise::transform_t transform) {
 
@@ -86,50 +86,22 @@ void PhaseNoise::spectrum_to_phase_noise(PhaseNoise::transform_t transform) {
         // std::cout << "mean Gt : " << mymath::mean(Gt.data(), Gt.size()) <<
         // "\n";
 
-        // FFT to frequency domain
-        complex_vector_t Gf;
-        fft::rfft(Gt, Gf);
-        // auto sum = 0.0;
-        // for (const auto &v : Gf)
-        //    sum += std::abs(v);
-
-        // std::cout << "mean abs(Gf) : " << sum / Gf.size() << "\n";
-
-        // Multiply by desired noise probability density
+        // Desired noise probability density as the spectrum of the kernel,
+        // applied to the white noise by one FFT convolution
         factor = 2 * fFreqArrayMax;
-        auto f3 = [factor](ftype x) { return std::sqrt(factor * x); };
-
-        r1.resize(fRes.size());
-        std::transform(fRes.begin(), fRes.end(), r1.begin(), f3);
+        complex_vector_t s(fNt / 2 + 1, complex_t(0, 0));
+        for (uint i = 0; i < std::min((uint)s.size(), fResLen); ++i)
+            s[i] = std::sqrt(factor * fRes[i]);
 
-        // std::cout << "mean s : " << mymath::mean(r1.data(), r1.size()) <<
-        // "\n";
-
-        auto f4 = [](ftype r, complex_t z) { return r * z; };
-        std::transform(r1.begin(), r1.end(), Gf.begin(), Gf.begin(), f4);
-        // sum = 0.0;
-        // for (const auto &v : Gf)
-        //    sum += std::abs(v);
-
-        // std::cout << "mean abs(dPf) : " << sum / Gf.size() << "\n";
-
-        // fft back to time domain to get final phase shift
-        Gt.clear();
-        fft::irfft(Gf, Gt);
-
-        // std::cout << "mean dpt : " << mymath::mean(Gt.data(), Gt.size()) <<
-        // "\n";
+        fft::FftConvolver convolver(fNt);
+        convolver.set_kernel_spectrum(s.data());
+        fDphi.resize(fNt);
+        convolver.convolve(Gt.data(), fNt, fDphi.data(), fNt);
 
         // Use only real part of the phase shift and normalize
         fT.resize(fNt);
         mymath::linspace(fT.data(), 0, fNt * fDt, fNt);
 
-        auto f6 = [](complex_t z) { return z.real(); };
-
-        fDphi.resize(Gt.size());
-
-        std::transform(Gt.begin(), Gt.end(), fDphi.begin(), f6);
-
     } else if (transform == transform_t::c) {
 
         complex_vector_t Gt(fNt);
@@ -151,8 +123,8 @@ void PhaseNoise::spectrum_to_phase_noise(PhaseNoise::transform_t transform) {
         // std::cout << "mean abs(Gt) : " << sum / Gt.size() << "\n";
 
         // FFT to frequency domain
-        complex_vector_t Gf;
-        fft::fft(Gt, Gf);
+        complex_vector_t Gf(fNt);
+        fft::execute_fft(fNt, Gt.data(), Gf.data());
 
         // sum = 0.0;
         // for (const auto &v : Gf)
@@ -163,9 +135,12 @@ void PhaseNoise::spectrum_to_phase_noise(PhaseNoise::transform_t transform) {
         // Multiply by desired noise probability density
 
         auto factor2 = fFreqArrayMax;
+        const ftype norm = 1.0 / fNt;
         // std::cout << factor2 << "\n";
         // std::cout << fRes.size() << "\n";
-        auto f4 = [factor2](ftype x) { return std::sqrt(factor2 * x); };
+        auto f4 = [factor2, norm](ftype x) {
+            return norm * std::sqrt(factor2 * x);
+        };
 
         r1.resize(fRes.size());
         std::transform(fRes.begin(), fRes.end(), r1.begin(), f4);
@@ -187,8 +162,7 @@ void PhaseNoise::spectrum_to_phase_noise(PhaseNoise::transform_t transform) {
         // std::cout << "mean abs(dPf) : " << sum / Gf.size() << "\n";
 
         // fft back to time domain to get final phase shift
-        Gt.clear();
-        fft::ifft(Gf, Gt);
+        fft::execute_fft(fNt, Gf.data(), Gt.data(), true);
 
         // sum = 0.0;
         // for (const auto &v : Gt)
@@ -0,0 +1,81 @@
+/*
+ * math_functions.cpp
+ *
+ *  Timing based choice between the convolution methods of math_functions.h
+ */
+
+#include <blond/math_functions.h>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace mymath {
+
+    // Best of a few runs of one convolution method, only the convolution
+    // itself is timed
+    static double time_convolution(convolution_method_t method,
+                                   bool kernelReused, const f_vector_t& signal,
+                                   const f_vector_t& kernel, f_vector_t& res) {
+        fft::FftConvolver* convolver = NULL;
+        if (method == fft_convolution && kernelReused) {
+            convolver = new fft::FftConvolver(fft::good_size(res.size()),
+                                              fft::default_threads());
+            convolver->set_kernel(kernel.data(), kernel.size());
+        }
+
+        double best = 0;
+        for (int rep = 0; rep < 3; ++rep) {
+            const double start = omp_get_wtime();
+            if (method == direct_convolution)
+                convolution(signal.data(), signal.size(), kernel.data(),
+                            kernel.size(), res.data());
+            else if (convolver != NULL)
+                convolver->convolve(signal.data(), signal.size(), res.data(),
+                                    res.size());
+            else
+                convolution_overlap_add(signal.data(), signal.size(),
+                                        kernel.data(), kernel.size(),
+                                        res.data());
+            const double elapsed = omp_get_wtime() - start;
+            best = (rep == 0) ? elapsed : std::min(best, elapsed);
+        }
+        delete convolver;
+        return best;
+    }
+
+    convolution_method_t convolution_method(const int SignalLen,
+                                            const int KernelLen,
+                                            bool kernelReused) {
+        static std::map<std::tuple<int, int, bool>, convolution_method_t>
+            cache;
+        static std::mutex lock;
+
+        if (SignalLen <= 0 || KernelLen <= 0)
+            return direct_convolution;
+        const auto key = std::make_tuple(std::min(SignalLen, KernelLen),
+                                         std::max(SignalLen, KernelLen),
+                                         kernelReused);
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = cache.find(key);
+        if (it != cache.end())
+            return it->second;
+
+        f_vector_t signal(SignalLen), kernel(KernelLen);
+        f_vector_t res(SignalLen + KernelLen - 1);
+        for (int i = 0; i < SignalLen; ++i)
+            signal[i] = std::sin(0.1 * i);
+        for (int i = 0; i < KernelLen; ++i)
+            kernel[i] = std::exp(-0.01 * i);
+
+        const double direct = time_convolution(direct_convolution,
+                                               kernelReused, signal, kernel,
+                                               res);
+        const double fft = time_convolution(fft_convolution, kernelReused,
+                                            signal, kernel, res);
+
+        const auto method =
+            (direct <= fft) ? direct_convolution : fft_convolution;
+        cache[key] = method;
+        return method;
+    }
+}
@@ -19,10 +19,42 @@ inline void RingAndRfSection::kick(const ftype* __restrict beam_dt,
                                    const ftype* __restrict omega_RF,
                                    const ftype* __restrict phi_RF,
                                    const int n_macroparticles,
-                                   const ftype acc_kick) {
+                                   const ftype acc_kick, const int phase_rf,
+                                   const ftype phase_alpha,
+                                   ftype* phase_sums) {
     // KICK
     //#pragma omp parallel for collapse(2)
     for (int j = 0; j < n_rf; ++j) {
+        if (j == phase_rf) {
+            // The same sine, with the cosine of the same call, reduced
+            // into the beam phase sums. A window costs an exp per particle
+            ftype sin_sum = 0, cos_sum = 0;
+            if (phase_alpha != 0) {
+#pragma omp parallel for reduction(+ : sin_sum, cos_sum)
+                for (int i = 0; i < n_macroparticles; ++i) {
+                    ftype s, c;
+                    mymath::fast_sincos<SIN_KERNEL_DEGREE>(
+                        omega_RF[j] * beam_dt[i] + phi_RF[j], s, c);
+                    beam_dE[i] += voltage[j] * s;
+                    const ftype w = std::exp(phase_alpha * beam_dt[i]);
+                    sin_sum += w * s;
+                    cos_sum += w * c;
+                }
+            } else {
+#pragma omp parallel for reduction(+ : sin_sum, cos_sum)
+                for (int i = 0; i < n_macroparticles; ++i) {
+                    ftype s, c;
+                    mymath::fast_sincos<SIN_KERNEL_DEGREE>(
+                        omega_RF[j] * beam_dt[i] + phi_RF[j], s, c);
+                    beam_dE[i] += voltage[j] * s;
+                    sin_sum += s;
+                    cos_sum += c;
+                }
+            }
+            phase_sums[0] = sin_sum;
+            phase_sums[1] = cos_sum;
+            continue;
+        }
 #pragma omp parallel for
         for (int i = 0; i < n_macroparticles; ++i) {
             // const ftype a = omega_RF[j] * beam_dt[i] + phi_RF[j];
@@ -59,16 +91,78 @@ inline void RingAndRfSection::kick(
         beam_dE[i] += acc_kick;
 }
 
+// Drift of every particle by step(dE), which also sums the energy of the
+// particles drifted into (frame_left, frame_right) while dE is loaded
+template <typename Step>
+static inline void drift_and_sum(ftype* __restrict beam_dt,
+                                 const ftype* __restrict beam_dE,
+                                 const int n_macroparticles,
+                                 const ftype frame_left,
+                                 const ftype frame_right, ftype* radial_sums,
+                                 const Step step) {
+    ftype sum = 0;
+    int n = 0;
+#pragma omp parallel for reduction(+ : sum, n)
+    for (int i = 0; i < n_macroparticles; i++) {
+        const ftype dE = beam_dE[i];
+        const ftype dt = beam_dt[i] + step(dE);
+        beam_dt[i] = dt;
+        const bool inside = dt > frame_left && dt < frame_right;
+        sum += inside ? dE : 0;
+        n += inside;
+    }
+    radial_sums[0] = sum;
+    radial_sums[1] = n;
+}
+
 // drift without periodicity
 inline void RingAndRfSection::drift(
     ftype* __restrict beam_dt, const ftype* __restrict beam_dE,
     const solver_type solver, const ftype T0, const ftype length_ratio,
     const uint alpha_order, const ftype eta_zero, const ftype eta_one,
     const ftype eta_two, const ftype beta, const ftype energy,
-    const int n_macroparticles) {
+    const int n_macroparticles, const ftype frame_left,
+    const ftype frame_right, ftype* radial_sums) {
 
     const ftype T = T0 * length_ratio;
 
+    if (radial_sums != NULL) {
+        // The same coefficients and steps as below, so that the sums do not
+        // change the tracking
+        if (solver == simple) {
+            const ftype T_x_coeff = T * eta_zero / (beta * beta * energy);
+            drift_and_sum(beam_dt, beam_dE, n_macroparticles, frame_left,
+                          frame_right, radial_sums,
+                          [=](const ftype dE) { return T_x_coeff * dE; });
+            return;
+        }
+        const ftype coeff = 1. / (beta * beta * energy);
+        const ftype eta0 = eta_zero * coeff;
+        const ftype eta1 = eta_one * coeff * coeff;
+        const ftype eta2 = eta_two * coeff * coeff * coeff;
+
+        if (alpha_order == 1)
+            drift_and_sum(beam_dt, beam_dE, n_macroparticles, frame_left,
+                          frame_right, radial_sums, [=](const ftype dE) {
+                              return T * (1. / (1. - eta0 * dE) - 1.);
+                          });
+        else if (alpha_order == 2)
+            drift_and_sum(
+                beam_dt, beam_dE, n_macroparticles, frame_left, frame_right,
+                radial_sums, [=](const ftype dE) {
+                    return T * (1. / (1. - eta0 * dE - eta1 * dE * dE) - 1.);
+                });
+        else
+            drift_and_sum(beam_dt, beam_dE, n_macroparticles, frame_left,
+                          frame_right, radial_sums, [=](const ftype dE) {
+                              return T * (1. / (1. - eta0 * dE -
+                                                eta1 * dE * dE -
+                                                eta2 * dE * dE * dE) -
+                                          1.);
+                          });
+        return;
+    }
+
     if (solver == simple) {
         const ftype T_x_coeff = T * eta_zero / (beta * beta * energy);
 #pragma omp parallel for
@@ -162,6 +256,7 @@ void RingAndRfSection::track() {
             //          << " right outside particles\n";
             for (const auto& i : indices_right_outside)
                 Beam->dt[i] -= GP->t_rev[RfP->counter + 1];
+            Beam->dt_version++;
         }
 
         // Synchronize the bunch with the particles that are on the right of
@@ -192,6 +287,7 @@ void RingAndRfSection::track() {
 
             for (const auto& i : indices_left_outside)
                 Beam->dt[i] += GP->t_rev[RfP->counter + 1];
+            Beam->dt_version++;
 
             kick(indices_left_outside, RfP->counter);
             drift(indices_left_outside, RfP->counter + 1);
@@ -226,6 +322,7 @@ inline void RingAndRfSection::horizontal_cut() {
         }
     }
     Beam->n_macroparticles = Beam->dE.size();
+    Beam->dt_version++;
 }
 
 RingAndRfSection::RingAndRfSection(solver_type _solver, PhaseLoop* _PhaseLoop,
@@ -317,8 +414,16 @@ inline void RingAndRfSection::kick(const uint index) {
         phi[i] = RfP->phi_RF[i][index];
     }
 
-    kick(Beam->dt.data(), Beam->dE.data(), RfP->n_rf, vol, omeg, phi,
-         Beam->n_macroparticles, acceleration_kick[index]);
+    if (PL != NULL && PL->particle_phase) {
+        ftype sums[2] = {0, 0};
+        kick(Beam->dt.data(), Beam->dE.data(), RfP->n_rf, vol, omeg, phi,
+             Beam->n_macroparticles, acceleration_kick[index], RfP->idx,
+             PL->alpha, sums);
+        PL->set_particle_sums(sums[0], sums[1]);
+    } else {
+        kick(Beam->dt.data(), Beam->dE.data(), RfP->n_rf, vol, omeg, phi,
+             Beam->n_macroparticles, acceleration_kick[index]);
+    }
 
     delete[] vol;
     delete[] omeg;
@@ -356,6 +461,7 @@ void RingAndRfSection::drift(const int_vector_t& filter, const uint index) {
           RfP->length_ratio, GP->alpha_order, RfP->eta_0(index),
           RfP->eta_1(index), RfP->eta_2(index), RfP->beta(index),
           RfP->energy(index), Beam->n_macroparticles, filter);
+    Beam->dt_version++;
 }
 
 inline void RingAndRfSection::drift(const uint index) {
@@ -363,8 +469,21 @@ inline void RingAndRfSection::drift(const uint index) {
     auto RfP = Context::RfP;
     auto Beam = Context::Beam;
 
-    drift(Beam->dt.data(), Beam->dE.data(), solver, GP->t_rev[index],
-          RfP->length_ratio, GP->alpha_order, RfP->eta_0(index),
-          RfP->eta_1(index), RfP->eta_2(index), RfP->beta(index),
-          RfP->energy(index), Beam->n_macroparticles);
+    // The sums would miss the particles removed by the horizontal cut
+    if (PL != NULL && PL->drift_radial && dE_max <= 0) {
+        auto Slice = Context::Slice;
+        ftype sums[2];
+        drift(Beam->dt.data(), Beam->dE.data(), solver, GP->t_rev[index],
+              RfP->length_ratio, GP->alpha_order, RfP->eta_0(index),
+              RfP->eta_1(index), RfP->eta_2(index), RfP->beta(index),
+              RfP->energy(index), Beam->n_macroparticles,
+              Slice->bin_centers.front(), Slice->bin_centers.back(), sums);
+        PL->set_radial_sums(sums[0], sums[1]);
+    } else {
+        drift(Beam->dt.data(), Beam->dE.data(), solver, GP->t_rev[index],
+              RfP->length_ratio, GP->alpha_order, RfP->eta_0(index),
+              RfP->eta_1(index), RfP->eta_2(index), RfP->beta(index),
+              RfP->energy(index), Beam->n_macroparticles);
+    }
+    Beam->dt_version++;
 }
@@ -1,6 +1,8 @@
+#include <fstream>
 #include <iostream>
 
 #include <gtest/gtest.h>
+#include <omp.h>
 #include <blond/fft.h>
 #include <blond/utilities.h>
 #include <blond/configuration.h>
@@ -488,6 +490,258 @@ TEST(testRFFTFREQ, odd_spacing)
 
 }
 
+TEST(testPlanRegistry, shared_plans)
+{
+   // One plan per size and type, used by every thread
+   auto &plan = fft::find_plan(64, fft::RFFT, 1);
+   ASSERT_EQ(&plan, &fft::find_plan(64, fft::RFFT, 1));
+   ASSERT_NE(&plan, &fft::find_plan(64, fft::IRFFT, 1));
+
+   f_vector_t in(64);
+   for (unsigned int i = 0; i < in.size(); ++i)
+      in[i] = std::sin(0.1 * i) + i % 3;
+   complex_vector_t ref;
+   fft::rfft(in, ref);
+
+   int failures = 0;
+   #pragma omp parallel for reduction(+ : failures)
+   for (int rep = 0; rep < 64; ++rep) {
+      f_vector_t v(in), back;
+      complex_vector_t out;
+      fft::rfft(v, out);
+      fft::irfft(out, back);
+      for (unsigned int i = 0; i < in.size(); ++i)
+         failures += (out[i / 2] != ref[i / 2]) +
+                     (std::fabs(back[i] - in[i]) > 1e-12);
+   }
+   ASSERT_EQ(0, failures);
+   fft::destroy_plans();
+}
+
+TEST(testPlanRegistry, measured_plans_and_wisdom)
+{
+   ASSERT_TRUE(fft::set_wisdom_file(""));
+   ASSERT_FALSE(fft::export_wisdom());
+
+   fft::set_planner_flags(FFTW_MEASURE);
+   ASSERT_EQ((uint) (FFTW_MEASURE | FFTW_DESTROY_INPUT), fft::planner_flags());
+
+   f_vector_t in(120), out;
+   for (unsigned int i = 0; i < in.size(); ++i)
+      in[i] = std::cos(0.2 * i);
+   complex_vector_t spectrum;
+   fft::rfft(in, spectrum);
+   fft::irfft(spectrum, out);
+   for (unsigned int i = 0; i < in.size(); ++i)
+      ASSERT_NEAR(in[i], out[i], 1e-12) << "on i " << i;
+
+   // The measured plans can be stored and read again
+   const std::string file = "testFFT_wisdom.dat";
+   fft::set_wisdom_file(file);
+   ASSERT_TRUE(fft::export_wisdom());
+   ASSERT_TRUE(fft::set_wisdom_file(file));
+
+   fft::set_wisdom_file("");
+   std::remove(file.c_str());
+   fft::set_planner_flags(FFTW_ESTIMATE);
+   fft::destroy_plans();
+}
+
+TEST(testPlanRegistry, new_array_execute)
+{
+   const uint n = 96;
+   f_vector_t in(n), ref;
+   for (unsigned int i = 0; i < n; ++i)
+      in[i] = std::sin(0.3 * i) * (i % 5);
+   complex_vector_t refSpectrum;
+   f_vector_t copy(in);
+   fft::rfft(copy, refSpectrum);
+   fft::irfft(refSpectrum, ref);
+
+   // Aligned buffers are used in place, the others through the plan
+   ftype *real = (ftype *) fftw_malloc(sizeof(ftype) * (n + 2));
+   complex_t *spectrum =
+      (complex_t *) fftw_malloc(sizeof(complex_t) * (n / 2 + 2));
+   for (int offset = 0; offset < 2; ++offset) {
+      ftype *r = real + offset;
+      complex_t *z = spectrum + offset;
+      std::copy(in.begin(), in.end(), r);
+      fft::execute_rfft(n, r, z);
+      for (unsigned int i = 0; i < refSpectrum.size(); ++i)
+         ASSERT_NEAR(0, std::abs(refSpectrum[i] - z[i]), 1e-12)
+               << "on i " << i << ", offset " << offset;
+
+      // Not normalised
+      fft::execute_irfft(n, z, r);
+      for (unsigned int i = 0; i < n; ++i)
+         ASSERT_NEAR(n * ref[i], r[i], 1e-10) << "on i " << i;
+   }
+   fftw_free(real);
+   fftw_free(spectrum);
+
+   complex_vector_t a(n), b(n), c(n);
+   for (unsigned int i = 0; i < n; ++i)
+      a[i] = complex_t(in[i], i % 7);
+   fft::execute_fft(n, a.data(), b.data());
+   fft::execute_fft(n, b.data(), c.data(), true);
+   for (unsigned int i = 0; i < n; ++i)
+      ASSERT_NEAR(0, std::abs(c[i] / (ftype) n - a[i]), 1e-12) << "on i " << i;
+
+   fft::destroy_plans();
+}
+
+TEST(testFftConvolver, convolve_and_correlate)
+{
+   f_vector_t a(50), b(20);
+   for (unsigned int i = 0; i < a.size(); ++i)
+      a[i] = std::cos(0.2 * i) + 0.05 * i;
+   for (unsigned int i = 0; i < b.size(); ++i)
+      b[i] = std::exp(-0.2 * i);
+
+   const uint size = a.size() + b.size() - 1;
+   f_vector_t conv(size, 0), corr(a.size(), 0);
+   for (unsigned int i = 0; i < a.size(); ++i)
+      for (unsigned int j = 0; j < b.size(); ++j) {
+         conv[i + j] += a[i] * b[j];
+         if (i >= j)
+            corr[i - j] += a[i] * b[j];
+      }
+
+   fft::FftConvolver convolver(size);
+   convolver.set_kernel(b.data(), b.size());
+   f_vector_t res(size), res2;
+   const ftype factor = 3;
+   // The same kernel for several signals
+   for (int rep = 0; rep < 2; ++rep) {
+      convolver.convolve(a.data(), a.size(), res.data(), size, factor);
+      for (unsigned int i = 0; i < size; ++i)
+         ASSERT_NEAR(factor * conv[i], res[i], 1e-10) << "on i " << i;
+   }
+
+   convolver.correlate(a.data(), a.size(), res.data(), a.size());
+   for (unsigned int i = 0; i < a.size(); ++i)
+      ASSERT_NEAR(corr[i], res[i], 1e-10) << "on i " << i;
+
+   mymath::convolution_with_ffts(a, b, res2);
+   ASSERT_EQ(size, res2.size());
+   for (unsigned int i = 0; i < size; ++i)
+      ASSERT_NEAR(conv[i], res2[i], 1e-10) << "on i " << i;
+}
+
+static bool smooth(uint n, const std::vector<uint> &primes)
+{
+   for (const auto p : primes)
+      while (n % p == 0)
+         n /= p;
+   return n == 1;
+}
+
+TEST(testFftSize, next_regular)
+{
+   for (uint target = 0; target < 3000; ++target) {
+      uint n = target + 1;
+      while (!smooth(n, {2, 3, 5}))
+         ++n;
+      ASSERT_EQ(n, fft::next_regular(target)) << "on target " << target;
+   }
+   ASSERT_EQ(1u, fft::next_regular(0));
+   ASSERT_EQ(1024u, fft::next_regular(1000));
+}
+
+TEST(testFftSize, good_size)
+{
+   // Without tuning nothing changes
+   ASSERT_EQ(fft::next_regular(1000), fft::good_size(1000));
+
+   const std::string file = "testFFT_sizes.dat";
+   std::remove(file.c_str());
+   ASSERT_FALSE(fft::set_size_tuning(true, file));
+
+   std::vector<uint> sizes;
+   for (const uint target : {1000u, 4097u, 30000u}) {
+      const uint n = fft::good_size(target);
+      ASSERT_GT(n, target);
+      ASSERT_TRUE(smooth(n, {2, 3, 5, 7, 11})) << "on size " << n;
+      ASSERT_LE(n, 2 * fft::next_regular(target));
+      // Tuned once
+      ASSERT_EQ(n, fft::good_size(target));
+      sizes.push_back(n);
+   }
+
+   // The results are read back from the file
+   ASSERT_TRUE(fft::set_size_tuning(false));
+   ASSERT_TRUE(fft::set_size_tuning(true, file));
+   std::ifstream in(file);
+   uint target, flags, threads, size, count = 0;
+   while (in >> target >> flags >> threads >> size) {
+      ASSERT_EQ(fft::planner_flags(), flags);
+      ASSERT_EQ(fft::fft_threads(target, fft::RFFT, fft::default_threads()),
+                threads);
+      ASSERT_EQ(sizes[count], size);
+      ASSERT_EQ(size, fft::good_size(target));
+      ++count;
+   }
+   ASSERT_EQ(3u, count);
+   in.close();
+
+   // Other planner flags are tuned on their own
+   const uint oldFlags = fft::planner_flags();
+   fft::set_planner_flags(FFTW_MEASURE);
+   fft::good_size(1000);
+   fft::set_planner_flags(oldFlags);
+   std::ifstream again(file);
+   count = 0;
+   while (again >> target >> flags >> threads >> size)
+      ++count;
+   ASSERT_EQ(4u, count);
+
+   fft::set_size_tuning(false);
+   std::remove(file.c_str());
+}
+
+TEST(testFftThreads, thread_policy)
+{
+   const uint elems = fft::elems_per_thread(fft::RFFT);
+   ASSERT_EQ(fft::ELEMS_PER_THREAD_RFFT, elems);
+   ASSERT_EQ(fft::ELEMS_PER_THREAD_FFT, fft::elems_per_thread(fft::IFFT));
+
+   fft::set_elems_per_thread(fft::IRFFT, 1000);
+   ASSERT_EQ(1000u, fft::elems_per_thread(fft::RFFT));
+
+   const uint maxThreads = omp_get_max_threads();
+#ifdef USE_FFTW_OMP
+   ASSERT_EQ(1u, fft::fft_threads(1000, fft::RFFT, 8));
+   ASSERT_EQ(std::min(3u, maxThreads), fft::fft_threads(2500, fft::RFFT, 8));
+   ASSERT_EQ(std::min(2u, maxThreads), fft::fft_threads(1e6, fft::RFFT, 2));
+   ASSERT_EQ(maxThreads > 1, fft::measure_thread_crossovers(4096));
+   if (maxThreads > 1) {
+      ASSERT_LE(fft::elems_per_thread(fft::FFT), 4096u);
+   }
+#else
+   ASSERT_FALSE(fft::measure_thread_crossovers(4096));
+   ASSERT_EQ(1u, fft::fft_threads(1e6, fft::RFFT, 8));
+#endif
+
+   // Never threaded inside other OpenMP work
+   uint inside = 0;
+   #pragma omp parallel num_threads(2) reduction(max : inside)
+   inside = fft::fft_threads(1e6, fft::RFFT, 8);
+   if (maxThreads > 1) {
+      ASSERT_EQ(1u, inside);
+   }
+
+   // Plans are shared by the requests with the same thread count
+   if (fft::fft_threads(1000, fft::RFFT, 4) ==
+       fft::fft_threads(1000, fft::RFFT, 1)) {
+      ASSERT_EQ(&fft::find_plan(1000, fft::RFFT, 4),
+                &fft::find_plan(1000, fft::RFFT, 1));
+   }
+
+   fft::set_elems_per_thread(fft::RFFT, elems);
+   fft::set_elems_per_thread(fft::FFT, fft::ELEMS_PER_THREAD_FFT);
+   fft::destroy_plans();
+}
+
 
 int main(int ac, char *av[])
 {
@@ -465,6 +465,427 @@ TEST_F(testInducedVoltage, totalInducedVoltageTrack)
 }
 
 
+TEST_F(testInducedVoltage, cached_wake_spectrum)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageTime *freqDomain = new InducedVoltageTime(wakeSourceList);
+   InducedVoltageTime *timeDomain =
+      new InducedVoltageTime(wakeSourceList, time_or_freq::time_domain);
+
+   ftype epsilon = 1e-8;
+   for (int turn = 0; turn < 2; ++turn) {
+      auto res = freqDomain->induced_voltage_generation();
+      auto v = timeDomain->induced_voltage_generation();
+      ASSERT_EQ(v.size(), res.size());
+      ftype max = *std::max_element(v.begin(), v.end(),
+                                    [](ftype a, ftype b) {
+                                       return fabs(a) < fabs(b);
+                                    });
+      for (unsigned int i = 0; i < res.size(); ++i) {
+         ASSERT_NEAR(v[i], res[i], epsilon * fabs(max))
+               << "Testing of inducedVoltage failed on i "
+               << i << std::endl;
+      }
+      // The cached spectrum has to be rebuilt by reprocess
+      freqDomain->reprocess();
+      timeDomain->reprocess();
+   }
+
+   delete freqDomain;
+   delete timeDomain;
+}
+
+TEST_F(testInducedVoltage, track_memory)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   const uint n_turns_mem = 2;
+   const ftype frame = Slice->edges.back() - Slice->edges.front();
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageFreq *indVoltFreq =
+      new InducedVoltageFreq(wakeSourceList, 0, round_option, n_turns_mem);
+   std::vector<InducedVoltage *> indVoltList({indVoltFreq});
+   TotalInducedVoltage *totVol =
+      new TotalInducedVoltage(indVoltList, n_turns_mem,
+                              f_vector_t(N_t + 1, frame));
+
+   ASSERT_EQ((n_turns_mem + 1) * N_slices, totVol->fLenArrayMemory);
+
+   totVol->track();
+   auto v1 = totVol->fVoltageMemory;
+   ftype max = 0;
+   for (auto &x : v1) max = std::max(max, fabs(x));
+   ASSERT_GT(max, 0);
+
+   // Without beam the memory is only shifted by one frame
+   std::fill(Slice->n_macroparticles.begin(),
+             Slice->n_macroparticles.end(), 0);
+   totVol->track();
+   auto v2 = totVol->fVoltageMemory;
+
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < v2.size(); ++i) {
+      ftype ref = i + N_slices < v1.size() ? v1[i + N_slices] : 0;
+      ASSERT_NEAR(ref, v2[i], epsilon * max)
+            << "Testing of fVoltageMemory failed on i "
+            << i << std::endl;
+   }
+   ASSERT_EQ(2u, totVol->fCounterTurn);
+
+   delete totVol;
+   delete indVoltFreq;
+}
+
+TEST_F(testInducedVoltage, track_memory_short_rev_time)
+{
+   auto GP = Context::GP;
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   // After the given revolution times those of GP are used
+   const uint n_turns_mem = 2;
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageFreq *indVoltFreq =
+      new InducedVoltageFreq(wakeSourceList, 0, round_option, n_turns_mem);
+   std::vector<InducedVoltage *> indVoltList({indVoltFreq});
+   TotalInducedVoltage *shortRev =
+      new TotalInducedVoltage(indVoltList, n_turns_mem,
+                              f_vector_t(1, GP->t_rev[0]));
+   TotalInducedVoltage *noRev =
+      new TotalInducedVoltage(indVoltList, n_turns_mem);
+
+   for (uint turn = 0; turn < 3; ++turn) {
+      shortRev->track();
+      noRev->track();
+   }
+   ASSERT_EQ(3u, shortRev->fCounterTurn);
+   ASSERT_EQ(noRev->fVoltageMemory, shortRev->fVoltageMemory);
+
+   delete shortRev;
+   delete noRev;
+   delete indVoltFreq;
+}
+
+TEST_F(testInducedVoltage, ghost_voltage_generation)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageTime *indVoltTime =
+      new InducedVoltageTime(wakeSourceList, time_or_freq::time_domain);
+   std::vector<InducedVoltage *> indVoltList({indVoltTime});
+   TotalInducedVoltage *totVol = new TotalInducedVoltage(indVoltList);
+
+   // Two ghosts on top of the simulated bunch see twice its own wake
+   totVol->set_ghost_bunches(2, 0.0);
+   ASSERT_EQ(2u * N_slices - 1, totVol->fGhostWake.size());
+
+   auto v = indVoltTime->induced_voltage_generation();
+   auto res = totVol->ghost_voltage_generation();
+   ASSERT_EQ(v.size(), res.size());
+
+   ftype max = 0;
+   for (auto &x : v) max = std::max(max, fabs(x));
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      ASSERT_NEAR(2 * v[i], res[i], epsilon * max)
+            << "Testing of ghost voltage failed on i "
+            << i << std::endl;
+   }
+
+   delete totVol;
+   delete indVoltTime;
+}
+
+TEST_F(testInducedVoltage, ghost_voltage_impedance)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+   const ftype spacing = 2 * (Slice->cut_right - Slice->cut_left);
+
+   // The ghosts of an impedance are phase shifts of the impedance, they
+   // must see the same voltage as the ghosts of the equivalent wake
+   std::vector<Intensity *> sourceList({resonator});
+   InducedVoltageTime *indVoltTime =
+      new InducedVoltageTime(sourceList, time_or_freq::time_domain);
+   std::vector<InducedVoltage *> timeList({indVoltTime});
+   TotalInducedVoltage *timeVol = new TotalInducedVoltage(timeList);
+   timeVol->set_ghost_bunches(2, spacing);
+   auto v = timeVol->ghost_voltage_generation();
+
+   InducedVoltageFreq *indVoltFreq =
+      new InducedVoltageFreq(sourceList, 1e5);
+   std::vector<InducedVoltage *> freqList({indVoltFreq});
+   TotalInducedVoltage *freqVol = new TotalInducedVoltage(freqList);
+   freqVol->set_ghost_bunches(2, spacing);
+   ASSERT_TRUE(freqVol->fGhostWake.empty());
+   auto res = freqVol->ghost_voltage_generation();
+   ASSERT_EQ(v.size(), res.size());
+
+   ftype max = 0;
+   for (auto &x : v) max = std::max(max, fabs(x));
+   ASSERT_GT(max, 0);
+   ftype epsilon = 2e-3;
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      ASSERT_NEAR(v[i], res[i], epsilon * max)
+            << "Testing of ghost voltage failed on i "
+            << i << std::endl;
+   }
+
+   delete freqVol;
+   delete indVoltFreq;
+   delete timeVol;
+   delete indVoltTime;
+}
+
+TEST_F(testInducedVoltage, merged_impedances)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> impSourceList({resonator});
+   InducedVoltageFreq *indVoltFreq1 =
+      new InducedVoltageFreq(impSourceList, 1e5);
+   InducedVoltageFreq *indVoltFreq2 =
+      new InducedVoltageFreq(impSourceList, 1e5);
+   auto v = indVoltFreq1->induced_voltage_generation(200);
+
+   std::vector<InducedVoltage *> indVoltList({indVoltFreq1, indVoltFreq2});
+   TotalInducedVoltage *totVol = new TotalInducedVoltage(indVoltList);
+   auto res = totVol->induced_voltage_sum(200);
+   ASSERT_EQ(v.size(), res.size());
+   ASSERT_EQ(indVoltFreq1->fInducedVoltage.size(),
+             totVol->fInducedVoltage.size());
+
+   ftype max = 0;
+   for (auto &x : v) max = std::max(max, fabs(x));
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      ASSERT_NEAR(2 * v[i], res[i], epsilon * max)
+            << "Testing of extIndVolt failed on i "
+            << i << std::endl;
+   }
+   for (unsigned int i = 0; i < totVol->fInducedVoltage.size(); ++i) {
+      ASSERT_NEAR(2 * indVoltFreq1->fInducedVoltage[i],
+                  totVol->fInducedVoltage[i], epsilon * max)
+            << "Testing of fInducedVoltage failed on i "
+            << i << std::endl;
+   }
+
+   delete totVol;
+   delete indVoltFreq1;
+   delete indVoltFreq2;
+}
+
+TEST_F(testInducedVoltage, resonator_recursive)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageTime *indVoltTime =
+      new InducedVoltageTime(wakeSourceList, time_or_freq::time_domain);
+   InducedVoltageResonator *indVoltRes =
+      new InducedVoltageResonator(resonator);
+
+   auto v = indVoltTime->induced_voltage_generation();
+   auto res = indVoltRes->induced_voltage_generation();
+   ASSERT_EQ(v.size(), res.size());
+
+   ftype max = 0;
+   for (auto &x : v) max = std::max(max, fabs(x));
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      ASSERT_NEAR(v[i], res[i], epsilon * max)
+            << "Testing of inducedVoltage failed on i "
+            << i << std::endl;
+   }
+
+   delete indVoltTime;
+   delete indVoltRes;
+}
+
+TEST_F(testInducedVoltage, resonator_recursive_memory)
+{
+   auto Slice = Context::Slice;
+   auto RfP = Context::RfP;
+   Slice->track();
+
+   InducedVoltageResonator *indVoltRes =
+      new InducedVoltageResonator(resonator, true);
+   auto v1 = indVoltRes->induced_voltage_generation();
+   // Calling again on the same turn must not advance the memory
+   v1 = indVoltRes->induced_voltage_generation();
+   RfP->counter++;
+   auto v2 = indVoltRes->induced_voltage_generation();
+   RfP->counter--;
+
+   // The previous turn acts as a bunch ahead by one revolution period
+   std::vector<InducedVoltage *> indVoltList({indVoltRes});
+   TotalInducedVoltage *totVol = new TotalInducedVoltage(indVoltList);
+   totVol->set_ghost_bunches(1, Context::GP->t_rev[0]);
+   auto ghost = totVol->ghost_voltage_generation();
+
+   ftype max = 0;
+   for (auto &x : ghost) max = std::max(max, fabs(x));
+   ASSERT_GT(max, 0);
+   ftype epsilon = 1e-6;
+   for (unsigned int i = 0; i < ghost.size(); ++i) {
+      ASSERT_NEAR(ghost[i], v2[i] - v1[i], epsilon * max)
+            << "Testing of memory voltage failed on i "
+            << i << std::endl;
+   }
+
+   delete totVol;
+   delete indVoltRes;
+}
+
+TEST_F(testInducedVoltage, inductive_impedance)
+{
+   auto GP = Context::GP;
+   auto Beam = Context::Beam;
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   const ftype ZOverN = 2.0;
+   InductiveImpedance *indImp =
+      new InductiveImpedance(f_vector_t(1, ZOverN));
+   std::vector<InducedVoltage *> indVoltList({indImp});
+   TotalInducedVoltage *totVol = new TotalInducedVoltage(indVoltList);
+   ASSERT_TRUE(totVol->fInductiveImpedanceOn);
+
+   auto res = totVol->induced_voltage_sum(Slice->n_slices);
+   auto derivative = Slice->beam_profile_derivative();
+   const ftype dist = Slice->bin_centers[1] - Slice->bin_centers[0];
+
+   ftype max = 0;
+   for (auto &x : res) max = std::max(max, fabs(x));
+   ASSERT_GT(max, 0);
+   ftype epsilon = 1e-10;
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      const ftype ref = -GP->charge * constant::e / (2 * constant::pi)
+                        * Beam->ratio * ZOverN * GP->t_rev[0] / dist
+                        * derivative[i];
+      ASSERT_NEAR(ref, res[i], epsilon * max)
+            << "Testing of inductive voltage failed on i "
+            << i << std::endl;
+   }
+
+   delete totVol;
+   delete indImp;
+}
+
+TEST_F(testInducedVoltage, auto_domain)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageTime *autoDomain =
+      new InducedVoltageTime(wakeSourceList, time_or_freq::auto_domain);
+   InducedVoltageTime *timeDomain =
+      new InducedVoltageTime(wakeSourceList, time_or_freq::time_domain);
+   ASSERT_NE(time_or_freq::auto_domain, autoDomain->fTimeOrFreq);
+
+   auto res = autoDomain->induced_voltage_generation();
+   auto v = timeDomain->induced_voltage_generation();
+   ASSERT_EQ(v.size(), res.size());
+
+   ftype max = 0;
+   for (auto &x : v) max = std::max(max, fabs(x));
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      ASSERT_NEAR(v[i], res[i], epsilon * max)
+            << "Testing of inducedVoltage failed on i "
+            << i << std::endl;
+   }
+
+   // The mode may be switched after construction
+   timeDomain->fTimeOrFreq = time_or_freq::freq_domain;
+   res = timeDomain->induced_voltage_generation();
+   ASSERT_EQ(v.size(), res.size());
+   for (unsigned int i = 0; i < res.size(); ++i) {
+      ASSERT_NEAR(v[i], res[i], epsilon * max)
+            << "Testing of switched inducedVoltage failed on i "
+            << i << std::endl;
+   }
+
+   delete autoDomain;
+   delete timeDomain;
+}
+
+TEST_F(testInducedVoltage, reprocess_incremental)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageTime *indVoltTime = new InducedVoltageTime(wakeSourceList);
+   std::vector<InducedVoltage *> indVoltList({indVoltTime});
+   TotalInducedVoltage *totVol = new TotalInducedVoltage(indVoltList);
+   auto wake = indVoltTime->fTotalWake;
+
+   // A shift of the frame keeps the wake, even with modified sources
+   for (auto &r : resonator->fRS) r *= 2;
+   const ftype shift = Slice->bin_centers[2] - Slice->bin_centers[0];
+   for (auto &b : Slice->bin_centers) b += shift;
+   totVol->reprocess();
+   ASSERT_EQ(Slice->bin_centers, totVol->fTimeArray);
+   for (unsigned int i = 0; i < wake.size(); ++i)
+      ASSERT_EQ(wake[i], indVoltTime->fTotalWake[i]) << "on i " << i;
+
+   // Until the objects are invalidated
+   totVol->invalidate();
+   totVol->reprocess();
+   ftype epsilon = 1e-10;
+   for (unsigned int i = 0; i < wake.size(); ++i)
+      ASSERT_NEAR(2 * wake[i], indVoltTime->fTotalWake[i],
+                  epsilon * fabs(wake[i])) << "on i " << i;
+
+   // A new spacing resamples the wake
+   const ftype step = indVoltTime->fTimeArray[1];
+   for (auto &b : Slice->bin_centers) b *= 1.1;
+   totVol->reprocess();
+   ASSERT_NEAR(1.1 * step, indVoltTime->fTimeArray[1], epsilon * step);
+
+   delete totVol;
+   delete indVoltTime;
+}
+
+TEST_F(testInducedVoltage, track_with_stored_bins)
+{
+   auto Beam = Context::Beam;
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   std::vector<Intensity *> wakeSourceList({resonator});
+   InducedVoltageTime *indVoltTime = new InducedVoltageTime(wakeSourceList);
+   f_vector_t dE = Beam->dE;
+   indVoltTime->track();
+   f_vector_t ref = Beam->dE;
+
+   Beam->dE = dE;
+   Slice->store_bins = true;
+   Slice->track();
+   indVoltTime->track();
+
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < Beam->n_macroparticles; ++i) {
+      ASSERT_NEAR(ref[i], Beam->dE[i],
+                  epsilon * std::max(fabs(ref[i]), fabs(Beam->dE[i])))
+            << "Testing of Beam->dE failed on i "
+            << i << std::endl;
+   }
+
+   delete indVoltTime;
+}
+
+
 int main(int ac, char *av[])
 {
    ::testing::InitGoogleTest(&ac, av);
@@ -420,6 +420,104 @@ TEST_F(testInducedVoltageFreq, induced_voltage_generation1)
    delete indVoltFreq;
 }
 
+TEST_F(testInducedVoltageFreq, induced_voltage_generation2)
+{
+   std::vector<Intensity *> ImpSourceList({resonator, resonator});
+
+   auto indVoltFreq = new InducedVoltageFreq(ImpSourceList, 1e5,
+         freq_res_option_t::round_option, 0, false, true);
+	Context::Slice->track();
+
+   indVoltFreq->induced_voltage_generation();
+   auto params = std::string("../unit-tests/references/Impedances/")
+                 + "InducedVoltage/InducedVoltageFreq/induced_voltage_generation1/";
+
+   std::vector<ftype> v;
+
+   util::read_vector_from_file(v, params + "induced_voltage.txt");
+
+   const unsigned int n_slices = Context::Slice->n_slices;
+   ASSERT_EQ(v.size(), indVoltFreq->fInducedVoltage.size());
+   ASSERT_EQ(2 * n_slices, indVoltFreq->fMatrixSaveIndividualVoltages.size());
+
+   auto epsilon = 1e-8;
+   for (unsigned int i = 0; i < v.size(); ++i) {
+      auto ref = v[i];
+      ftype real = indVoltFreq->fInducedVoltage[i];
+      ASSERT_NEAR(2 * ref, real, 2 * epsilon * std::max(fabs(ref), fabs(real)))
+            << "Testing of indVoltFreq->fInducedVoltage failed on i "
+            << i << std::endl;
+      for (unsigned int j = 0; j < 2; ++j) {
+         real = indVoltFreq->fMatrixSaveIndividualVoltages[j * n_slices + i];
+         ASSERT_NEAR(ref, real, epsilon * std::max(fabs(ref), fabs(real)))
+               << "Testing of fMatrixSaveIndividualVoltages failed on i "
+               << i << " j " << j << std::endl;
+      }
+   }
+
+   delete indVoltFreq;
+}
+
+TEST_F(testInducedVoltageFreq, recalculation_period)
+{
+   auto RfP = Context::RfP;
+   std::vector<Intensity *> ImpSourceList({resonator});
+
+   auto indVoltFreq = new InducedVoltageFreq(ImpSourceList, 1e5,
+         freq_res_option_t::round_option, 0, true);
+   indVoltFreq->fRecalcPeriod = 2;
+	Context::Slice->track();
+
+   auto v0 = indVoltFreq->induced_voltage_generation();
+
+   // The new shunt impedances are only seen two turns later
+   for (auto &r : resonator->fRS) r *= 2;
+   RfP->counter = 1;
+   auto v1 = indVoltFreq->induced_voltage_generation();
+   RfP->counter = 2;
+   auto v2 = indVoltFreq->induced_voltage_generation();
+   RfP->counter = 0;
+
+   auto epsilon = 1e-8;
+   for (unsigned int i = 0; i < v0.size(); ++i) {
+      ASSERT_NEAR(v0[i], v1[i], epsilon * fabs(v0[i]))
+            << "Testing of turn 1 failed on i " << i << std::endl;
+      ASSERT_NEAR(2 * v0[i], v2[i], 2 * epsilon * fabs(v0[i]))
+            << "Testing of turn 2 failed on i " << i << std::endl;
+   }
+
+   delete indVoltFreq;
+}
+
+TEST_F(testInducedVoltageFreq, recalculation_resampled)
+{
+   auto Slice = Context::Slice;
+   std::vector<Intensity *> ImpSourceList({resonator});
+
+   auto indVoltFreq = new InducedVoltageFreq(ImpSourceList, 1e5,
+         freq_res_option_t::round_option, 0, true);
+   indVoltFreq->fRecalcPeriod = 0;
+   indVoltFreq->fRecalcTolerance = 0.1;
+   Slice->track();
+
+   auto v0 = indVoltFreq->induced_voltage_generation();
+   auto z0 = indVoltFreq->fTotalImpedance;
+
+   // A small change of spacing resamples the impedance, going back to the
+   // recalculated spacing restores it
+   auto centers = Slice->bin_centers;
+   for (auto &c : Slice->bin_centers) c *= 1.01;
+   indVoltFreq->induced_voltage_generation();
+   ASSERT_NE(z0, indVoltFreq->fTotalImpedance);
+   Slice->bin_centers = centers;
+   auto v2 = indVoltFreq->induced_voltage_generation();
+
+   ASSERT_EQ(z0, indVoltFreq->fTotalImpedance);
+   ASSERT_EQ(v0, v2);
+
+   delete indVoltFreq;
+}
+
 TEST_F(testInducedVoltageFreq, track1)
 {
    std::vector<Intensity *> ImpSourceList({resonator});
@@ -211,6 +211,69 @@ TEST_F(testInputTableIntensity, imped_calc)
 
 }
 
+TEST_F(testInputTableIntensity, fit_resonators)
+{
+   f_vector_t RS = {1e6, 4e5}, frequencyR = {1e9, 1.6e9}, Q = {10, 30};
+   Resonators source(RS, frequencyR, Q);
+
+   f_vector_t freqArray;
+   for (int i = 0; i < 4000; ++i)
+      freqArray.push_back(i * 1e6);
+   source.imped_calc(freqArray);
+
+   f_vector_t Re, Im;
+   for (const auto &z : source.fImpedance) {
+      Re.push_back(z.real());
+      Im.push_back(z.imag());
+   }
+   InputTable inputTable(freqArray, Re, Im);
+
+   ftype tolerance = 1e-3;
+   Resonators *fit = inputTable.fit_resonators(tolerance, 8);
+   ASSERT_LE(inputTable.fFitError, tolerance);
+   ASSERT_LE(fit->fNResonators, 4u);
+
+   fit->imped_calc(freqArray);
+   ftype scale = std::abs(source.fImpedance[1000]);
+   for (unsigned int i = 0; i < freqArray.size(); ++i)
+      ASSERT_NEAR(std::abs(source.fImpedance[i]), std::abs(fit->fImpedance[i]),
+                  10 * tolerance * scale)
+            << "Testing of the fitted impedance failed on i " << i << std::endl;
+   delete fit;
+}
+
+
+
+TEST_F(testInputTableIntensity, fit_resonators_broadband)
+{
+   // The quality factor of this broadband resonator is below the bound
+   // of the search, which has to approximate it with bounded resonators
+   f_vector_t RS = {2e5}, frequencyR = {2e9}, Q = {0.3};
+   Resonators source(RS, frequencyR, Q);
+
+   f_vector_t freqArray;
+   for (int i = 0; i < 4000; ++i)
+      freqArray.push_back(i * 1e6);
+   source.imped_calc(freqArray);
+
+   f_vector_t Re, Im;
+   for (const auto &z : source.fImpedance) {
+      Re.push_back(z.real());
+      Im.push_back(z.imag());
+   }
+   InputTable inputTable(freqArray, Re, Im);
+
+   ftype tolerance = 5e-2;
+   Resonators *fit = inputTable.fit_resonators(tolerance, 8);
+   ASSERT_LE(inputTable.fFitError, tolerance);
+   for (unsigned int i = 0; i < fit->fNResonators; ++i) {
+      ASSERT_GE(fit->fQ[i], 0.5);
+      ASSERT_LE(fit->fQ[i], 1e6);
+      ASSERT_GT(fit->fFrequencyR[i], 0);
+      ASSERT_LE(fit->fFrequencyR[i], freqArray.back());
+   }
+   delete fit;
+}
 
 
 int main(int ac, char *av[])
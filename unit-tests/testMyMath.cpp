@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 #include <list>
+#include <algorithm>
 
 #include <gtest/gtest.h>
 #include <blond/math_functions.h>
@@ -253,6 +254,143 @@ TEST(testConvolution, test3)
 
 }
 
+TEST(testConvolution, overlap_add_and_auto)
+{
+   std::vector<ftype> a(1000), b(37);
+   for (unsigned int i = 0; i < a.size(); ++i)
+      a[i] = std::sin(0.3 * i) + 0.1 * i;
+   for (unsigned int i = 0; i < b.size(); ++i)
+      b[i] = std::exp(-0.1 * i);
+
+   std::vector<ftype> v(a.size() + b.size() - 1), c(v.size()), d(v.size());
+   // Plain summation as reference
+   for (unsigned int n = 0; n < v.size(); ++n)
+      for (unsigned int k = 0; k < a.size(); ++k)
+         if (n >= k && n - k < b.size())
+            v[n] += a[k] * b[n - k];
+
+   ftype epsilon = 1e-8 * *std::max_element(v.begin(), v.end());
+   for (int swap = 0; swap < 2; ++swap) {
+      if (swap)
+         mymath::convolution_overlap_add(b.data(), b.size(),
+                                         a.data(), a.size(), c.data());
+      else
+         mymath::convolution_overlap_add(a.data(), a.size(),
+                                         b.data(), b.size(), c.data());
+      mymath::convolution_auto(a.data(), a.size(), b.data(), b.size(),
+                               d.data());
+      for (unsigned int i = 0; i < v.size(); ++i) {
+         ASSERT_NEAR(v[i], c[i], epsilon)
+               << "Testing of overlap-add failed on i " << i << std::endl;
+         ASSERT_NEAR(v[i], d[i], epsilon)
+               << "Testing of convolution_auto failed on i " << i << std::endl;
+      }
+   }
+
+   // The decision is cached per pair of lengths
+   auto method = mymath::convolution_method(a.size(), b.size());
+   ASSERT_EQ(method, mymath::convolution_method(b.size(), a.size()));
+   method = mymath::convolution_method(a.size(), b.size(), true);
+   ASSERT_EQ(method, mymath::convolution_method(b.size(), a.size(), true));
+
+   // Empty inputs leave the result untouched
+   std::vector<ftype> e(1, 7);
+   mymath::convolution(a.data(), 0, b.data(), b.size(), e.data());
+   mymath::convolution_overlap_add(a.data(), a.size(), b.data(), 0, e.data());
+   ASSERT_EQ(7, e[0]);
+}
+
+// Reference as numpy.interp, by a linear search
+static ftype interp_reference(ftype x, const std::vector<ftype> &xp,
+                              const std::vector<ftype> &yp)
+{
+   if (x < xp.front() || x > xp.back())
+      return 0;
+   unsigned int j = 0;
+   while (j + 1 < xp.size() && xp[j + 1] <= x)
+      ++j;
+   if (j + 1 == xp.size())
+      return yp[j];
+   return yp[j] + (yp[j + 1] - yp[j]) * (x - xp[j]) / (xp[j + 1] - xp[j]);
+}
+
+TEST(testLinInterp, uniform_sorted_and_unsorted)
+{
+   std::vector<ftype> uniform(200), stretched(200), yp(200);
+   for (unsigned int i = 0; i < yp.size(); ++i) {
+      uniform[i] = 0.1 + 0.01 * i;
+      stretched[i] = 0.1 + 1.99 * std::pow(i / 199.0, 2);
+      yp[i] = std::sin(0.1 * i);
+   }
+
+   // Large enough to be split over the threads, covering both tails and
+   // the points of xp exactly
+   std::vector<ftype> sorted(30001), shuffled, y;
+   mymath::linspace(sorted.data(), 0, 2.5, sorted.size());
+   sorted.insert(sorted.end(), uniform.begin(), uniform.end());
+   std::sort(sorted.begin(), sorted.end());
+   shuffled = sorted;
+   std::reverse(shuffled.begin(), shuffled.end());
+   std::swap(shuffled[10], shuffled[20000]);
+
+   for (const auto *xp : {&uniform, &stretched})
+      for (const auto *x : {&sorted, &shuffled}) {
+         mymath::lin_interp(*x, *xp, yp, y);
+         ASSERT_EQ(x->size(), y.size());
+         for (unsigned int i = 0; i < x->size(); ++i)
+            ASSERT_NEAR(interp_reference((*x)[i], *xp, yp), y[i], 1e-12)
+                  << "on i " << i;
+      }
+
+   // Complex values, both parts in one pass
+   std::vector<ftype> im(yp.size());
+   complex_vector_t cyp(yp.size()), cy;
+   for (unsigned int i = 0; i < yp.size(); ++i) {
+      im[i] = std::cos(0.2 * i);
+      cyp[i] = complex_t(yp[i], im[i]);
+   }
+   mymath::lin_interp(shuffled, stretched, cyp, cy, complex_t(1, 2));
+   for (unsigned int i = 0; i < shuffled.size(); ++i) {
+      const ftype x = shuffled[i];
+      if (x < stretched.front()) {
+         ASSERT_EQ(complex_t(1, 2), cy[i]);
+         continue;
+      }
+      ASSERT_NEAR(interp_reference(x, stretched, yp), cy[i].real(), 1e-12);
+      ASSERT_NEAR(interp_reference(x, stretched, im), cy[i].imag(), 1e-12);
+   }
+}
+
+template <int Degree>
+static void check_sincos(ftype bound)
+{
+   ftype errSin = 0, errCos = 0;
+   for (int i = -200000; i <= 200000; ++i) {
+      const ftype x = 1e-3 * i + 1e-7;
+      errSin = std::max(errSin,
+                        std::abs(mymath::fast_sin<Degree>(x) - std::sin(x)));
+      errCos = std::max(errCos,
+                        std::abs(mymath::fast_cos<Degree>(x) - std::cos(x)));
+   }
+   ASSERT_LT(errSin, bound) << "sine of degree " << Degree;
+   ASSERT_LT(errCos, bound) << "cosine of degree " << Degree;
+}
+
+TEST(testSinKernels, error_bounds)
+{
+   // Documented bounds of the polynomials, with room for the reduction
+   // of arguments up to 200
+   check_sincos<7>(5e-9);
+   check_sincos<9>(1e-11);
+   check_sincos<11>(1e-13);
+   check_sincos<13>(1e-13);
+
+   ftype s, c;
+   mymath::fast_sincos<9>(-2.5, s, c);
+   ASSERT_NEAR(std::sin(-2.5), s, 1e-11);
+   ASSERT_NEAR(std::cos(-2.5), c, 1e-11);
+}
+
 TEST(arange, test1)
 {
    std::string params = "../unit-tests/references/MyMath/arange/";
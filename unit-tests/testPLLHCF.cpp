@@ -3,6 +3,7 @@
 #include <blond/math_functions.h>
 #include <blond/beams/Distributions.h>
 #include <blond/llrf/PhaseLoop.h>
+#include <blond/trackers/Tracker.h>
 #include <gtest/gtest.h>
 
 // Simulation parameters --------------------------------------------------------
@@ -124,6 +125,90 @@ TEST_F(testPLLHCF, track1)
    delete lhcf;
 }
 
+// beam_phase as two trapezoid integrals, without the cached window
+static ftype beam_phase_reference(ftype alpha)
+{
+   auto Slice = Context::Slice;
+   auto RfP = Context::RfP;
+   const ftype omega_RF = RfP->omega_RF[RfP->idx][RfP->counter];
+   const ftype phi_RF = RfP->phi_RF[RfP->idx][RfP->counter];
+   f_vector_t s(Slice->n_slices), c(Slice->n_slices);
+   for (uint i = 0; i < Slice->n_slices; ++i) {
+      const ftype x = Slice->bin_centers[i];
+      const ftype base = std::exp(alpha * x) * Slice->n_macroparticles[i];
+      s[i] = base * std::sin(omega_RF * x + phi_RF);
+      c[i] = base * std::cos(omega_RF * x + phi_RF);
+   }
+   const ftype scoeff = mymath::trapezoid(s.data(),
+                                          Slice->bin_centers.data(),
+                                          Slice->n_slices);
+   const ftype ccoeff = mymath::trapezoid(c.data(),
+                                          Slice->bin_centers.data(),
+                                          Slice->n_slices);
+   return std::atan(scoeff / ccoeff) + constant::pi;
+}
+
+TEST_F(testPLLHCF, beam_phase_window)
+{
+   longitudinal_bigaussian(10e-9, 1e6, 10, false);
+   Context::Slice->track();
+
+   auto lhcf = new LHC_F(1.0 / 25e-6, 0, 0);
+   const ftype epsilon = 1e-12;
+
+   lhcf->beam_phase();
+   ASSERT_NEAR(beam_phase_reference(0), lhcf->phi_beam, epsilon);
+
+   // A new window coefficient
+   lhcf->alpha = 5e6;
+   lhcf->beam_phase();
+   ASSERT_NEAR(beam_phase_reference(5e6), lhcf->phi_beam, epsilon);
+
+   // Moved bins
+   for (auto &x : Context::Slice->bin_centers)
+      x += 2e-8;
+   lhcf->beam_phase();
+   ASSERT_NEAR(beam_phase_reference(5e6), lhcf->phi_beam, epsilon);
+
+   delete lhcf;
+}
+
+TEST_F(testPLLHCF, particle_beam_phase)
+{
+   longitudinal_bigaussian(10e-9, 1e6, 10, false);
+   Context::Slice->track();
+
+   auto lhcf = new LHC_F(1.0 / 25e-6, 0, 0);
+   lhcf->alpha = 5e6;
+   lhcf->particle_phase = true;
+   // Only the kick, the phase loop is not tracked
+   lhcf->delay = N_t;
+   auto tracker = new RingAndRfSection(simple, lhcf);
+
+   // Sums of the kick of the first turn
+   auto Beam = Context::Beam;
+   auto RfP = Context::RfP;
+   const ftype omega_RF = RfP->omega_RF[RfP->idx][0];
+   const ftype phi_RF = RfP->phi_RF[RfP->idx][0];
+   ftype s = 0, c = 0;
+   for (uint i = 0; i < Beam->n_macroparticles; ++i) {
+      const ftype w = std::exp(lhcf->alpha * Beam->dt[i]);
+      s += w * std::sin(omega_RF * Beam->dt[i] + phi_RF);
+      c += w * std::cos(omega_RF * Beam->dt[i] + phi_RF);
+   }
+
+   tracker->track();
+   lhcf->beam_phase();
+   ASSERT_NEAR(std::atan(s / c) + constant::pi, lhcf->phi_beam, 1e-10);
+
+   // The sums are used once, then the slices again
+   lhcf->beam_phase();
+   ASSERT_NEAR(beam_phase_reference(lhcf->alpha), lhcf->phi_beam, 1e-12);
+
+   delete tracker;
+   delete lhcf;
+}
+
 
 
 int main(int ac, char *av[])
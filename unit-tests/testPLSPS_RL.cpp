@@ -128,6 +128,88 @@ TEST_F(testPLSPS_RL, track1)
 }
 
 
+TEST_F(testPLSPS_RL, radial_difference_in_drift)
+{
+   longitudinal_bigaussian(200e-9, 100e6, 42321, false);
+   auto Beam = Context::Beam;
+   auto GP = Context::GP;
+   auto RfP = Context::RfP;
+   auto Slice = Context::Slice;
+   Slice->store_bins = true;
+
+   for (const auto solver : {simple, full}) {
+      auto sps = new SPS_RL(25e-6, 0, 5e-6);
+      sps->drift_radial = true;
+      // Only the tracker, the loop is not tracked
+      sps->delay = N_t;
+      RingAndRfSection tracker(solver, sps);
+
+      for (uint turn = 0; turn < 3; ++turn) {
+         tracker.track();
+         sps->radial_difference();
+         const ftype fused = sps->drho;
+         // Again from the beam, the bins are out of date after the drift
+         ASSERT_FALSE(Slice->bins_valid());
+         sps->radial_difference();
+         const ftype from_beam = sps->drho;
+         // And from the bins of a new slicing
+         Slice->track();
+         sps->radial_difference();
+
+         ftype sum = 0;
+         uint n = 0;
+         for (uint i = 0; i < Beam->n_macroparticles; ++i)
+            if (Beam->dt[i] > Slice->bin_centers.front()
+                  && Beam->dt[i] < Slice->bin_centers.back()) {
+               sum += Beam->dE[i];
+               ++n;
+            }
+         ASSERT_GT(n, 0u);
+         ASSERT_LT(n, Beam->n_macroparticles);
+         const uint c = RfP->counter;
+         const ftype drho = GP->alpha[0][0] * GP->ring_radius * sum / n
+                            / (GP->beta[0][c] * GP->beta[0][c]
+                               * GP->energy[0][c]);
+         ASSERT_NEAR(drho, from_beam, 1e-10 * std::fabs(drho));
+         ASSERT_NEAR(drho, fused, 1e-10 * std::fabs(drho));
+         ASSERT_NEAR(drho, sps->drho, 1e-10 * std::fabs(drho));
+      }
+      delete sps;
+      RfP->counter = 0;
+   }
+   Slice->store_bins = false;
+}
+
+TEST_F(testPLSPS_RL, drift_radial_bit_neutral)
+{
+   longitudinal_bigaussian(200e-9, 100e6, 42321, false);
+   auto Beam = Context::Beam;
+   auto RfP = Context::RfP;
+   const auto dt = Beam->dt;
+   const auto dE = Beam->dE;
+
+   // The sums of the drift must not change the tracking
+   for (const auto solver : {simple, full}) {
+      f_vector_t ref;
+      for (const bool fused : {false, true}) {
+         Beam->dt = dt;
+         Beam->dE = dE;
+         auto sps = new SPS_RL(25e-6, 0, 5e-6);
+         sps->drift_radial = fused;
+         sps->delay = N_t;
+         RingAndRfSection tracker(solver, sps);
+         for (uint turn = 0; turn < 3; ++turn)
+            tracker.track();
+         if (!fused)
+            ref = Beam->dt;
+         delete sps;
+         RfP->counter = 0;
+      }
+      for (uint i = 0; i < ref.size(); ++i)
+         ASSERT_EQ(ref[i], Beam->dt[i]) << "on i " << i;
+   }
+}
+
 TEST_F(testPLSPS_RL, track2)
 {
 
@@ -213,6 +213,34 @@ TEST_F(testResonator, wake_calc)
 }
 
 
+TEST_F(testResonator, wake_calc_any_grid)
+{
+	auto Slice = Context::Slice;
+   std::string params = "../unit-tests/references/Impedances/Intensity/";
+
+   std::vector<ftype> v;
+   util::read_vector_from_file(v, params + "Wake.txt");
+
+   // A decreasing grid with negative times does not use the recurrence
+   std::vector<ftype> timeArray;
+   for (int i = N_slices - 1; i >= 0; --i)
+      timeArray.push_back(Slice->bin_centers[i] - Slice->bin_centers[0]);
+   timeArray.push_back(-timeArray[N_slices - 2]);
+   resonator->wake_calc(timeArray);
+
+   ASSERT_EQ(v.size() + 1, resonator->fWake.size());
+   ASSERT_EQ(0, resonator->fWake.back());
+
+   ftype epsilon = 1e-8;
+   for (unsigned int i = 0; i < v.size(); ++i) {
+      ftype ref = v[i];
+      ftype real = resonator->fWake[N_slices - 1 - i];
+      ASSERT_NEAR(ref, real, epsilon * std::max(fabs(ref), fabs(real)))
+            << "Testing of fWake failed on i "
+            << i << std::endl;
+   }
+}
+
 TEST_F(testResonator, imped_calc)
 {
 	auto Slice = Context::Slice;
@@ -249,6 +277,40 @@ TEST_F(testResonator, imped_calc)
 }
 
 
+TEST_F(testResonator, imped_calc_cache)
+{
+   auto Slice = Context::Slice;
+
+   std::vector<ftype> freqArray;
+   for (int i = 0; i < N_slices; ++i)
+      freqArray.push_back((Slice->bin_centers[i] - Slice->bin_centers[0]) * 1e10);
+
+   resonator->imped_calc(freqArray);
+   auto ref = resonator->fImpedance;
+
+   // Another grid and then the first one again, served from the cache
+   std::vector<ftype> otherArray(freqArray);
+   for (auto &f : otherArray) f *= 2;
+   resonator->imped_calc(otherArray);
+   resonator->imped_calc(freqArray);
+   ASSERT_EQ(ref.size(), resonator->fImpedance.size());
+   for (unsigned int i = 0; i < ref.size(); ++i)
+      ASSERT_EQ(ref[i], resonator->fImpedance[i]) << "on i " << i;
+
+   // A change of the parameters must not be served from the cache, even
+   // without parameters_changed
+   for (auto &r : resonator->fRS) r *= 2;
+   resonator->imped_calc(freqArray);
+   ftype epsilon = 1e-10;
+   for (unsigned int i = 0; i < ref.size(); ++i) {
+      ASSERT_NEAR(2 * ref[i].real(), resonator->fImpedance[i].real(),
+                  epsilon * std::abs(ref[i])) << "on i " << i;
+      ASSERT_NEAR(2 * ref[i].imag(), resonator->fImpedance[i].imag(),
+                  epsilon * std::abs(ref[i])) << "on i " << i;
+   }
+}
+
+
 
 int main(int ac, char *av[])
 {
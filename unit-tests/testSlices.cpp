@@ -181,6 +181,138 @@ TEST_F(testSlices, n_macroparticles)
 }
 
 
+TEST_F(testSlices, store_bins)
+{
+   auto Slice = Context::Slice;
+   auto Beam = Context::Beam;
+   Slice->store_bins = true;
+   Slice->track();
+
+   ASSERT_TRUE(Slice->bins_valid());
+   ASSERT_EQ(Beam->n_macroparticles, Slice->bin_index.size());
+
+   int_vector_t hist(Slice->n_slices, 0);
+   for (uint i = 0; i < Beam->n_macroparticles; ++i) {
+      const int bin = Slice->bin_index[i];
+      if (bin < 0)
+         continue;
+      ASSERT_GE(Slice->bin_fraction[i], 0.0);
+      ASSERT_LT(Slice->bin_fraction[i], 1.0);
+      const ftype dt = Slice->edges[bin] + Slice->bin_fraction[i]
+                       * (Slice->edges[1] - Slice->edges[0]);
+      ASSERT_NEAR(Beam->dt[i], dt, epsilon * std::fabs(Beam->dt[i]));
+      hist[bin]++;
+   }
+
+   for (uint i = 0; i < Slice->n_slices; ++i)
+      ASSERT_EQ(Slice->n_macroparticles[i], hist[i]);
+
+   // Any modification of dt, also within a turn, invalidates the bins
+   Beam->dt_version++;
+   ASSERT_FALSE(Slice->bins_valid());
+   Slice->track();
+   ASSERT_TRUE(Slice->bins_valid());
+
+   // So does a move of the frame between two slicings
+   Slice->frame_version++;
+   ASSERT_FALSE(Slice->bins_valid());
+   Slice->track();
+   ASSERT_TRUE(Slice->bins_valid());
+   const ftype width = Slice->cut_right - Slice->cut_left;
+   Slice->cut_left += width / Slice->n_slices;
+   Slice->cut_right += width / Slice->n_slices;
+   ASSERT_FALSE(Slice->bins_valid());
+   Slice->track();
+   ASSERT_TRUE(Slice->bins_valid());
+
+   // And the generation of a new distribution
+   longitudinal_bigaussian(1e-9, 1e6, 1, false);
+   ASSERT_FALSE(Slice->bins_valid());
+}
+
+TEST_F(testSlices, beam_spectrum_generation)
+{
+   auto Slice = Context::Slice;
+   Slice->track();
+
+   // The profile zero padded to twice its length, as numpy.fft.rfft
+   const uint n = 2 * Slice->n_slices;
+   f_vector_t profile(Slice->n_macroparticles.begin(),
+                      Slice->n_macroparticles.end());
+   complex_vector_t ref;
+   fft::rfft(profile, ref, n);
+
+   // Twice, the buffers are kept between turns
+   for (int turn = 0; turn < 2; ++turn) {
+      Slice->beam_spectrum_generation(n);
+      ASSERT_EQ(ref.size(), Slice->fBeamSpectrum.size());
+      for (uint i = 0; i < ref.size(); ++i)
+         ASSERT_NEAR(0, std::abs(ref[i] - Slice->fBeamSpectrum[i]),
+                     epsilon * std::abs(ref[0])) << "on i " << i;
+   }
+
+   // With the alignment of the plan, which then needs no copies
+   auto &plan = fft::find_plan(n, fft::RFFT, Context::n_threads);
+   ASSERT_EQ(fftw_alignment_of((double *)plan.out),
+             fftw_alignment_of((double *)Slice->fBeamSpectrum.data()));
+}
+
+TEST_F(testSlices, beam_profile_derivative)
+{
+   auto Slice = Context::Slice;
+   const int n = Slice->n_slices;
+   const ftype dist = Slice->bin_centers[1] - Slice->bin_centers[0];
+
+   // A parabola, whose central difference is exact
+   for (int i = 0; i < n; ++i)
+      Slice->n_macroparticles[i] = i * i;
+
+   auto gradient = Slice->beam_profile_derivative(gradient_derivative);
+   auto diff = Slice->beam_profile_derivative(diff_derivative);
+   auto filter = Slice->beam_profile_derivative(filter1d_derivative);
+   ASSERT_EQ(n, gradient.size());
+   ASSERT_EQ(n, diff.size());
+   ASSERT_EQ(n, filter.size());
+
+   ASSERT_NEAR(1 / dist, gradient[0], epsilon / dist);
+   ASSERT_NEAR((2 * n - 3) / dist, gradient[n - 1], epsilon * n / dist);
+   for (int i = 1; i < n - 1; ++i) {
+      ASSERT_NEAR(2 * i / dist, gradient[i], epsilon * i / dist);
+      ASSERT_NEAR(gradient[i], diff[i], epsilon * i / dist);
+      // Away from the wrapped edges the smoothed derivative matches too
+      if (i >= 4 && i < n - 4) {
+         ASSERT_NEAR(2 * i / dist, filter[i], 1e-3 * i / dist);
+      }
+   }
+}
+
+TEST_F(testSlices, track_frame)
+{
+   auto Slice = Context::Slice;
+   auto Beam = Context::Beam;
+   const ftype width = Slice->edges[1] - Slice->edges[0];
+   const ftype cut_left = Slice->cut_left;
+
+   for (auto &dt : Beam->dt)
+      dt += 3.3 * width;
+
+   Slice->track_frame = true;
+   for (int i = 0; i < 10; ++i)
+      Slice->track();
+
+   ASSERT_GT(Slice->frame_version, 0u);
+   ASSERT_NEAR(width, Slice->edges[1] - Slice->edges[0], epsilon * width);
+
+   const ftype shift = (Slice->cut_left - cut_left) / width;
+   ASSERT_NEAR(3, shift, 1e-6);
+
+   int_vector_t hist = Slice->n_macroparticles;
+   Slice->track_frame = false;
+   Slice->track();
+   for (uint i = 0; i < Slice->n_slices; ++i)
+      ASSERT_EQ(hist[i], Slice->n_macroparticles[i]);
+}
+
 
 int main(int ac, char *av[])
 {